@@ -0,0 +1,185 @@
+/**
+ * @file Binary.h
+ * @brief Binary format of prebuilt topologies.
+ *
+ * Arrays are written in native byte order and padded to 8 bytes, so the tables of a file mapped to memory
+ * can be used in place without parsing or copying them (see Topology::load).
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WFC_BINARY_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace WFC::Binary
+{
+
+/**
+ * @brief First bytes of a file ("WFCT").
+ */
+constexpr uint32_t magic = 0x54434657;
+
+/**
+ * @brief Version of the format, incremented when the layout changes.
+ */
+constexpr uint32_t version = 3;
+
+/**
+ * @brief Read-only bytes and the owner that keeps them alive.
+ */
+struct Buffer
+{
+    /**
+     * @brief The bytes, aligned to 8 bytes.
+     */
+    std::shared_ptr<const void> data;
+
+    /**
+     * @brief The number of bytes.
+     */
+    size_t size = 0;
+};
+
+/**
+ * @brief Write an array padded to a multiple of 8 bytes.
+ * @tparam T The type of the elements, which has to be trivially copyable.
+ * @param stream The output stream, opened in binary mode.
+ * @param data The elements.
+ * @param count The number of elements.
+ */
+template <class T>
+void write(std::ostream& stream, const T* data, size_t count)
+{
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8, "The elements have to be trivially copyable and aligned to at most 8 bytes");
+
+    static const char padding[8] = {};
+    size_t bytes = count * sizeof(T);
+    stream.write(reinterpret_cast<const char*>(data), bytes);
+    stream.write(padding, (8 - bytes % 8) % 8);
+}
+
+/**
+ * @brief Reads the arrays written by write() in place.
+ */
+class Reader
+{
+public:
+    /**
+     * @brief Create a reader.
+     * @param buffer The bytes to read, they have to outlive the reader and the returned arrays.
+     * @throw std::runtime_error If the bytes are not aligned to 8 bytes.
+     */
+    explicit Reader(const Buffer& buffer) : data(static_cast<const char*>(buffer.data.get())), size(buffer.size)
+    {
+        if (reinterpret_cast<uintptr_t>(this->data) % 8 != 0)
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+    }
+
+    /**
+     * @brief Read the next array.
+     * @tparam T The type of the elements.
+     * @param count The number of elements.
+     * @return Pointer to the first element inside the bytes.
+     * @throw std::runtime_error If the bytes end before the array.
+     */
+    template <class T>
+    const T* read(size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= 8, "The elements have to be trivially copyable and aligned to at most 8 bytes");
+
+        size_t bytes = count * sizeof(T);
+        if ((count != 0 && bytes / count != sizeof(T)) || bytes > this->size - this->offset)
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+
+        const T* result = reinterpret_cast<const T*>(this->data + this->offset);
+        this->offset = std::min(this->size, this->offset + (bytes + 7) / 8 * 8);
+        return result;
+    }
+private:
+    const char* data;
+    size_t size;
+    size_t offset = 0;
+};
+
+/**
+ * @brief Read a file into memory.
+ * @param path The path of the file.
+ * @return The contents of the file.
+ * @throw std::runtime_error If the file cannot be read.
+ */
+inline Buffer readFile(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream)
+    {
+        throw std::runtime_error("Cannot read file");
+    }
+
+    size_t size = stream.tellg();
+    auto storage = std::make_shared<std::vector<uint64_t>>((size + 7) / 8);
+    stream.seekg(0);
+    if (!stream.read(reinterpret_cast<char*>(storage->data()), size))
+    {
+        throw std::runtime_error("Cannot read file");
+    }
+
+    return { std::shared_ptr<const void>(storage, storage->data()), size };
+}
+
+#if defined(WFC_BINARY_MMAP)
+/**
+ * @brief Map a file read-only to memory.
+ *
+ * The pages are shared between all processes that map the file and only loaded when they are accessed,
+ * the file is unmapped when the last owner of the buffer is destroyed.
+ *
+ * @param path The path of the file.
+ * @return The contents of the file.
+ * @throw std::runtime_error If the file cannot be mapped.
+ */
+inline Buffer mapFile(const std::string& path)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    struct stat status;
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0)
+    {
+        if (file >= 0)
+        {
+            close(file);
+        }
+
+        throw std::runtime_error("Cannot map file");
+    }
+
+    size_t size = status.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map file");
+    }
+
+    return { std::shared_ptr<const void>(data, [size](const void* data) { munmap(const_cast<void*>(data), size); }), size };
+}
+#endif
+
+}
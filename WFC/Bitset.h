@@ -0,0 +1,186 @@
+/**
+ * @file Bitset.h
+ * @brief Helpers for dense bitsets stored as arrays of 64-bit words.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * @brief Bitset helpers for dense bitsets.
+ *
+ * A bitset of size n is stored in getWords(n) consecutive 64-bit words, bit i is stored in word i / 64.
+ * Unused bits of the last word are always zero.
+ */
+namespace WFC::Bitset
+{
+
+/**
+ * @brief Get the number of words needed to store a bitset.
+ * @param size The number of bits.
+ * @return The number of words.
+ */
+constexpr size_t getWords(size_t size)
+{
+    return (size + 63) / 64;
+}
+
+/**
+ * @brief Count the number of set bits in a word.
+ * @param word The word.
+ * @return The number of set bits.
+ */
+inline size_t popcount(uint64_t word)
+{
+#if defined(_MSC_VER)
+    return __popcnt64(word);
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+/**
+ * @brief Get the index of the lowest set bit of a non-zero word.
+ * @param word The word.
+ * @return The index of the lowest set bit.
+ */
+inline size_t lowest(uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+/**
+ * @brief Check if a bit is set.
+ * @param words The bitset.
+ * @param i The index of the bit.
+ * @return True if the bit is set, false otherwise.
+ */
+inline bool test(const uint64_t* words, size_t i)
+{
+    return words[i / 64] >> (i % 64) & 1;
+}
+
+/**
+ * @brief Set a bit.
+ * @param words The bitset.
+ * @param i The index of the bit.
+ */
+inline void set(uint64_t* words, size_t i)
+{
+    words[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+/**
+ * @brief Clear a bit.
+ * @param words The bitset.
+ * @param i The index of the bit.
+ */
+inline void reset(uint64_t* words, size_t i)
+{
+    words[i / 64] &= ~(uint64_t(1) << (i % 64));
+}
+
+/**
+ * @brief Set the first size bits and clear the remaining bits of the last word.
+ * @param words The bitset.
+ * @param size The number of bits.
+ */
+inline void fill(uint64_t* words, size_t size)
+{
+    for (size_t w = 0; w < size / 64; w++)
+    {
+        words[w] = ~uint64_t(0);
+    }
+
+    if (size % 64 != 0)
+    {
+        words[size / 64] = (uint64_t(1) << (size % 64)) - 1;
+    }
+}
+
+/**
+ * @brief Count the number of set bits.
+ * @param words The bitset.
+ * @param count The number of words.
+ * @return The number of set bits.
+ */
+inline size_t count(const uint64_t* words, size_t count)
+{
+    size_t result = 0;
+    for (size_t w = 0; w < count; w++)
+    {
+        result += Bitset::popcount(words[w]);
+    }
+
+    return result;
+}
+
+/**
+ * @brief Count the number of bits set in both bitsets.
+ * @param a The first bitset.
+ * @param b The second bitset.
+ * @param count The number of words.
+ * @return The number of common set bits.
+ */
+inline size_t countCommon(const uint64_t* a, const uint64_t* b, size_t count)
+{
+    size_t result = 0;
+    for (size_t w = 0; w < count; w++)
+    {
+        result += Bitset::popcount(a[w] & b[w]);
+    }
+
+    return result;
+}
+
+/**
+ * @brief Get the index of the first set bit.
+ * @param words The bitset.
+ * @param count The number of words.
+ * @return The index of the first set bit or count * 64 if no bit is set.
+ */
+inline size_t first(const uint64_t* words, size_t count)
+{
+    for (size_t w = 0; w < count; w++)
+    {
+        if (words[w] != 0)
+        {
+            return w * 64 + Bitset::lowest(words[w]);
+        }
+    }
+
+    return count * 64;
+}
+
+/**
+ * @brief Call a function for every set bit in ascending order.
+ * @tparam Function The type of the function.
+ * @param words The bitset.
+ * @param count The number of words.
+ * @param function The function to call with the index of each set bit.
+ */
+template <class Function>
+void forEach(const uint64_t* words, size_t count, Function&& function)
+{
+    for (size_t w = 0; w < count; w++)
+    {
+        for (uint64_t word = words[w]; word != 0; word &= word - 1)
+        {
+            function(w * 64 + Bitset::lowest(word));
+        }
+    }
+}
+
+}
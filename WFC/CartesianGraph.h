@@ -0,0 +1,181 @@
+/**
+ * @file CartesianGraph.h
+ * @brief CartesianGraph class for grids with implicit adjacent nodes.
+ */
+
+#pragma once
+
+#include "Graph.h"
+
+#include <array>
+#include <cstdint>
+
+namespace WFC
+{
+
+/**
+ * @brief CartesianGraph class for grids with implicit adjacent nodes.
+ *
+ * The adjacent nodes of a grid are determined by the coordinates of a node, so they are computed from the strides of the grid instead of being stored.
+ * Directions are first negative, then positive for each dimension. For example, in 2D, the directions are [left, right, up, down].
+ *
+ * @tparam Dim The number of dimensions.
+ */
+template <size_t Dim>
+class CartesianGraph
+{
+public:
+    /**
+     * @brief Index of a missing adjacent node.
+     */
+    static constexpr uint32_t none = Graph::none;
+
+    CartesianGraph() = default;
+
+    /**
+     * @brief Create a grid graph.
+     * @param size The size of the grid.
+     * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
+     */
+    CartesianGraph(const std::array<size_t, Dim>& size, const std::array<bool, Dim>& periods = {}) : dims(size), periods(periods), count(1)
+    {
+        for (size_t a = 0; a < Dim; a++)
+        {
+            this->strides[a] = this->count;
+            this->count *= size[a];
+        }
+    }
+
+    /**
+     * @brief Get the number of nodes.
+     * @return The number of nodes.
+     */
+    size_t size() const
+    {
+        return this->count;
+    }
+
+    /**
+     * @brief Get the number of directions of a node.
+     * @return The number of directions.
+     */
+    static constexpr size_t getDegree(size_t)
+    {
+        return Dim * 2;
+    }
+
+    /**
+     * @brief Get the number of directions of all nodes.
+     * @return The number of slots.
+     */
+    size_t getSlots() const
+    {
+        return this->count * Dim * 2;
+    }
+
+    /**
+     * @brief Get the index of the first slot of a node.
+     * @param node The index of the node.
+     * @return The index of the slot.
+     */
+    size_t getSlot(size_t node) const
+    {
+        return node * Dim * 2;
+    }
+
+    /**
+     * @brief Get the adjacent node in a specific direction.
+     * @param node The index of the node.
+     * @param direction The direction.
+     * @return The index of the adjacent node or CartesianGraph::none.
+     */
+    uint32_t getAdjacent(size_t node, size_t direction) const
+    {
+        // The nodes are indexed with 32 bits, so the coordinate is found with 32-bit divisions, which are faster
+        size_t a = direction / 2;
+        size_t coord = uint32_t(node) / uint32_t(this->strides[a]) % uint32_t(this->dims[a]);
+        if (direction % 2 == 0)
+        {
+            return coord != 0 ? node - this->strides[a] : this->periods[a] ? node + (this->dims[a] - 1) * this->strides[a] : none;
+        }
+
+        return coord != this->dims[a] - 1 ? node + this->strides[a] : this->periods[a] ? node - (this->dims[a] - 1) * this->strides[a] : none;
+    }
+
+    /**
+     * @brief Get the size of the grid.
+     * @return The size of the grid.
+     */
+    const std::array<size_t, Dim>& getSize() const
+    {
+        return this->dims;
+    }
+
+    /**
+     * @brief Get whether the grid is periodic in each dimension.
+     * @return The periods of the grid.
+     */
+    const std::array<bool, Dim>& getPeriods() const
+    {
+        return this->periods;
+    }
+
+    /**
+     * @brief Write the graph in the binary format of Topology::save.
+     * @param stream The output stream, opened in binary mode.
+     */
+    void save(std::ostream& stream) const
+    {
+        std::array<uint64_t, Dim + 1> dims = { Dim };
+        std::array<uint8_t, Dim> periods;
+        for (size_t a = 0; a < Dim; a++)
+        {
+            dims[a + 1] = this->dims[a];
+            periods[a] = this->periods[a];
+        }
+
+        Binary::write(stream, dims.data(), dims.size());
+        Binary::write(stream, periods.data(), periods.size());
+    }
+
+    /**
+     * @brief Read a graph written by save().
+     * @param reader The reader of the binary data.
+     * @return The graph.
+     * @throw std::runtime_error If the data is not a grid with the same number of dimensions or has too many nodes.
+     */
+    static CartesianGraph load(Binary::Reader& reader)
+    {
+        const uint64_t* dims = reader.read<uint64_t>(Dim + 1);
+        if (dims[0] != Dim)
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+
+        // The nodes are indexed with 32 bits, CartesianGraph::none is not a node
+        const uint8_t* periods = reader.read<uint8_t>(Dim);
+        std::array<size_t, Dim> size;
+        std::array<bool, Dim> periodic;
+        uint64_t count = 1;
+        for (size_t a = 0; a < Dim; a++)
+        {
+            size[a] = dims[a + 1];
+            periodic[a] = periods[a] != 0;
+            if (size[a] >= none || (size[a] != 0 && count > (none - 1) / size[a]))
+            {
+                throw std::runtime_error("Invalid binary data");
+            }
+
+            count *= size[a];
+        }
+
+        return CartesianGraph(size, periodic);
+    }
+private:
+    std::array<size_t, Dim> dims = {};
+    std::array<size_t, Dim> strides = {};
+    std::array<bool, Dim> periods = {};
+    size_t count = 0;
+};
+
+}
@@ -6,12 +6,36 @@
 #pragma once
 
 #include "Topology.h"
+#include "CartesianGraph.h"
 
 #include <map>
 #include <array>
 #include <vector>
+#include <memory>
+#include <cstdint>
 #include <numeric>
+#include <algorithm>
+#include <stdexcept>
 #include <functional>
+#include <unordered_map>
+#include <memory_resource>
+
+namespace WFC
+{
+
+/**
+ * @brief CartesianGrid is a topology with a grid structure.
+ * 
+ * The adjacent nodes are computed from the coordinates of the nodes instead of being stored.
+ * 
+ * @tparam Dim The number of dimensions.
+ * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the collapse.
+ */
+template <size_t Dim, class State, class Observer = NoObserver>
+using CartesianGrid = Topology<State, CartesianGraph<Dim>, Observer>;
+
+}
 
 /**
  * @brief CartesianTopology for creating topologies with a grid structure.
@@ -24,11 +48,80 @@ namespace WFC::CartesianTopology
 {
 
 template <class State>
-using Rule = std::function<bool(const Node<State>& target, const Node<State>& node, const State& nodeState)>;
+using Rule = std::function<bool(size_t target, size_t node, const State& nodeState)>;
 
 template <size_t Dim>
 using Vec = std::array<size_t, Dim>;
 
+/**
+ * @brief Symmetry class of a 2D tile, named after the letter with the same symmetries.
+ */
+enum class Symmetry
+{
+    /**
+     * @brief Unchanged by rotations and reflections, such as a cross, 1 variant.
+     */
+    X,
+
+    /**
+     * @brief Unchanged by half turns and reflections, such as a straight line, 2 variants.
+     */
+    I,
+
+    /**
+     * @brief Unchanged by half turns and reflections along a diagonal, such as a diagonal line, 2 variants.
+     */
+    Diagonal,
+
+    /**
+     * @brief Unchanged by one reflection along an axis, such as a T junction, 4 variants.
+     */
+    T,
+
+    /**
+     * @brief Unchanged by one reflection along a diagonal, such as a corner, 4 variants.
+     */
+    L,
+
+    /**
+     * @brief Changed by every rotation and reflection, 8 variants.
+     */
+    F,
+};
+
+/**
+ * @brief A rotated or reflected variant of a 2D tile.
+ * @tparam Tile The type of the tiles.
+ */
+template <class Tile>
+struct Variant
+{
+    /**
+     * @brief The tile.
+     */
+    Tile tile;
+
+    /**
+     * @brief The number of clockwise quarter turns, applied after the reflection.
+     */
+    uint8_t rotation = 0;
+
+    /**
+     * @brief Whether the tile is reflected horizontally (left and right are swapped).
+     */
+    bool mirrored = false;
+
+    bool operator==(const Variant& other) const
+    {
+        return this->tile == other.tile && this->rotation == other.rotation && this->mirrored == other.mirrored;
+    }
+
+    bool operator<(const Variant& other) const
+    {
+        return this->tile < other.tile || (!(other.tile < this->tile) && (this->mirrored < other.mirrored || (this->mirrored == other.mirrored && this->rotation < other.rotation)));
+    }
+};
+
 /**
  * @brief Get the index of a node with a specific coordinate.
  * @tparam Dim The number of dimensions.
@@ -79,6 +172,43 @@ Vec<Dim> getCoord(size_t index, const Vec<Dim>& size)
     return coords;
 }
 
+/**
+ * @brief Create a direction-aware compatible function answered from a lookup table.
+ * 
+ * The compatible function is evaluated once for every pair of states in every direction,
+ * the returned function only tests a bit of the table.
+ * 
+ * @tparam Dim The number of dimensions.
+ * @param count The number of states.
+ * @param compatible The compatible function of the state indices.
+ * @return The direction-aware compatible function.
+ */
+template <size_t Dim>
+std::function<bool(size_t, size_t, size_t)> createLookup(size_t count, const std::function<bool(size_t, size_t, size_t)>& compatible)
+{
+    // Bitset of states b compatible with state a in direction d: [d][a][word]
+    size_t words = Bitset::getWords(count);
+    auto table = std::make_shared<std::vector<uint64_t>>(Dim * 2 * count * words, 0);
+    for (size_t d = 0; d < Dim * 2; d++)
+    {
+        for (size_t a = 0; a < count; a++)
+        {
+            for (size_t b = 0; b < count; b++)
+            {
+                if (compatible(a, d, b))
+                {
+                    Bitset::set(&(*table)[(d * count + a) * words], b);
+                }
+            }
+        }
+    }
+
+    return [table = std::shared_ptr<const std::vector<uint64_t>>(std::move(table)), count, words](size_t aState, size_t direction, size_t bState)
+    {
+        return Bitset::test(&(*table)[(direction * count + aState) * words], bState);
+    };
+}
+
 /**
  * @brief Create a cartesian topology with a specific size, states and weights.
  * 
@@ -86,36 +216,25 @@ Vec<Dim> getCoord(size_t index, const Vec<Dim>& size)
  * 
  * @tparam Dim The number of dimensions.
  * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the collapse.
  * @param size The size of the grid.
  * @param states The states of the nodes.
  * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
  * @param weights The weights of the states.
+ * @param resource The memory resource of the storage of the nodes.
  * @return The grid topology.
  */
-template <size_t Dim, class State>
-Topology<State> createCart(const Vec<Dim>& size, const std::vector<State>& states, const std::array<bool, Dim>& periods = {}, const std::map<State, float>& weights = {})
+template <size_t Dim, class State, class Observer = NoObserver>
+CartesianGrid<Dim, State, Observer> createCart(
+    const Vec<Dim>& size,
+    const std::vector<State>& states,
+    const std::array<bool, Dim>& periods = {},
+    const std::map<State, float>& weights = {},
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource())
 {
-    Topology<State> grid;
-    grid.nodes = std::vector<Node<State>>(std::reduce(size.begin(), size.end(), 1, std::multiplies<size_t>()));
+    CartesianGrid<Dim, State, Observer> grid(states, CartesianGraph<Dim>(size, periods), resource);
     grid.weights = weights;
-
-    for (size_t i = 0; i < grid.nodes.size(); i++)
-    {
-        Vec<Dim> coords = CartesianTopology::getCoord(i, size);
-
-        grid.nodes[i].states = states;
-        grid.nodes[i].adjacent = std::vector<Node<State>*>(Dim * 2);
-        for (size_t a = 0; a < Dim; a++)
-        {
-            Vec<Dim> coordsNegative = coords, coordsPositive = coords;
-            coordsNegative[a] = coords[a] != 0 ? coords[a] - 1 : size[a] - 1;
-            coordsPositive[a] = coords[a] != size[a] - 1 ? coords[a] + 1 : 0;
-            grid.nodes[i].adjacent[2 * a] = coords[a] != 0 || periods[a] ? &grid.nodes[CartesianTopology::getIndex(coordsNegative, size)] : nullptr;
-            grid.nodes[i].adjacent[2 * a + 1] = coords[a] != size[a] - 1 || periods[a] ? &grid.nodes[CartesianTopology::getIndex(coordsPositive, size)] : nullptr;
-        }
-    }
-
-    grid.compatible = [](const Node<State>&, const State&, const Node<State>&, const State&) { return true; };
+    grid.compatible = [](size_t, const State&, size_t, size_t, const State&) { return true; };
 
     return grid;
 }
@@ -128,32 +247,26 @@ Topology<State> createCart(const Vec<Dim>& size, const std::vector<State>& state
  * 
  * @tparam Dim The number of dimensions.
  * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the collapse.
  * @param size The size of the grid.
  * @param rules The rules of the states.
  * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
  * @param weights The weights of the states.
  * @return The grid topology.
  */
-template <size_t Dim, class State>
-Topology<State> createCartRules(const Vec<Dim>& size, const std::map<State, std::array<Rule<State>, Dim * 2>>& rules, const std::array<bool, Dim>& periods = {}, const std::map<State, float>& weights = {})
+template <size_t Dim, class State, class Observer = NoObserver>
+CartesianGrid<Dim, State, Observer> createCartRules(const Vec<Dim>& size, const std::map<State, std::array<Rule<State>, Dim * 2>>& rules, const std::array<bool, Dim>& periods = {}, const std::map<State, float>& weights = {})
 {
     std::vector<State> states;
     states.reserve(rules.size());
     std::transform(rules.begin(), rules.end(), std::back_inserter(states), [](const auto& kv) { return kv.first; });
 
-    Topology<State> grid = CartesianTopology::createCart(size, states, periods, weights);
-    grid.compatible = [rules](const Node<State>& a, const State& aState, const Node<State>& b, const State& bState)
+    CartesianGrid<Dim, State, Observer> grid = CartesianTopology::createCart<Dim, State, Observer>(size, states, periods, weights);
+    // The rules are shared, so copies of the grid do not copy them
+    auto shared = std::make_shared<const std::map<State, std::array<Rule<State>, Dim * 2>>>(rules);
+    grid.compatible = [shared](size_t a, const State& aState, size_t direction, size_t b, const State& bState)
     {
-        for (size_t i = 0; i < Dim * 2; i++)
-        {
-            size_t j = i ^ 1;
-            if (a.adjacent[i] == &b && b.adjacent[j] == &a)
-            {
-                return rules.at(aState)[i](a, b, bState) && rules.at(bState)[j](b, a, aState);
-            }
-        }
-
-        return false;
+        return shared->at(aState)[direction](a, b, bState) && shared->at(bState)[direction ^ 1](b, a, aState);
     };
 
     return grid;
@@ -167,36 +280,46 @@ Topology<State> createCartRules(const Vec<Dim>& size, const std::map<State, std:
  * 
  * @tparam Dim The number of dimensions.
  * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the collapse.
  * @param size The size of the grid.
  * @param adjacent The adjacent states of the nodes.
  * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
  * @param weights The weights of the states.
  * @return The grid topology.
  */
-template <size_t Dim, class State>
-Topology<State> createCartAdjacent(const Vec<Dim>& size, const std::map<State, std::array<std::vector<State>, Dim * 2>>& adjacent, const std::array<bool, Dim>& periods = {}, const std::map<State, float>& weights = {})
+template <size_t Dim, class State, class Observer = NoObserver>
+CartesianGrid<Dim, State, Observer> createCartAdjacent(const Vec<Dim>& size, const std::map<State, std::array<std::vector<State>, Dim * 2>>& adjacent, const std::array<bool, Dim>& periods = {}, const std::map<State, float>& weights = {})
 {
     std::vector<State> states;
     states.reserve(adjacent.size());
     std::transform(adjacent.begin(), adjacent.end(), std::back_inserter(states), [](const auto& kv) { return kv.first; });
 
-    Topology<State> grid = CartesianTopology::createCart(size, states, periods, weights);
-    grid.compatible = [adjacent](const Node<State>& a, const State& aState, const Node<State>& b, const State& bState)
+    // Bitset of the adjacent states of each state in each direction: [d][a][word]
+    size_t words = Bitset::getWords(states.size());
+    std::vector<uint64_t> available(Dim * 2 * states.size() * words, 0);
+    for (size_t a = 0; a < states.size(); a++)
     {
-        for (size_t i = 0; i < Dim * 2; i++)
+        for (size_t d = 0; d < Dim * 2; d++)
         {
-            size_t j = i ^ 1;
-            if (a.adjacent[i] == &b && b.adjacent[j] == &a)
+            for (const State& bState : adjacent.at(states[a])[d])
             {
-                std::vector<State> availableA = adjacent.at(aState)[i];
-                std::vector<State> availableB = adjacent.at(bState)[j];
-                return std::find(availableA.begin(), availableA.end(), bState) != availableA.end() &&
-                    std::find(availableB.begin(), availableB.end(), aState) != availableB.end();
+                auto it = std::lower_bound(states.begin(), states.end(), bState);
+                if (it != states.end() && *it == bState)
+                {
+                    Bitset::set(&available[(d * states.size() + a) * words], it - states.begin());
+                }
             }
         }
+    }
 
-        return false;
-    };
+    CartesianGrid<Dim, State, Observer> grid = CartesianTopology::createCart<Dim, State, Observer>(size, states, periods, weights);
+    grid.compatibleStates = CartesianTopology::createLookup<Dim>(
+        states.size(),
+        [&available, &states, words](size_t aState, size_t direction, size_t bState)
+        {
+            return Bitset::test(&available[(direction * states.size() + aState) * words], bState) &&
+                Bitset::test(&available[((direction ^ 1) * states.size() + bState) * words], aState);
+        });
 
     return grid;
 }
@@ -210,35 +333,411 @@ Topology<State> createCartAdjacent(const Vec<Dim>& size, const std::map<State, s
  * @tparam Dim The number of dimensions.
  * @tparam State The type of the states.
  * @tparam Token The type of the tokens.
+ * @tparam Observer The type of the observer of the collapse.
  * @param size The size of the grid.
  * @param tokens The tokens of the nodes.
  * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
  * @param weights The weights of the states.
  * @return The grid topology.
  */
-template <size_t Dim, class State, class Token>
-Topology<State> createCartTokens(const Vec<Dim>& size, const std::map<State, std::array<Token, Dim * 2>>& tokens, const std::array<bool, Dim>& periods = {}, const std::map<State, float>& weights = {})
+template <size_t Dim, class State, class Token, class Observer = NoObserver>
+CartesianGrid<Dim, State, Observer> createCartTokens(const Vec<Dim>& size, const std::map<State, std::array<Token, Dim * 2>>& tokens, const std::array<bool, Dim>& periods = {}, const std::map<State, float>& weights = {})
 {
     std::vector<State> states;
     states.reserve(tokens.size());
     std::transform(tokens.begin(), tokens.end(), std::back_inserter(states), [](const auto& kv) { return kv.first; });
 
-    Topology<State> grid = CartesianTopology::createCart(size, states, periods, weights);
-    grid.compatible = [tokens](const Node<State>& a, const State& aState, const Node<State>& b, const State& bState)
+    CartesianGrid<Dim, State, Observer> grid = CartesianTopology::createCart<Dim, State, Observer>(size, states, periods, weights);
+    grid.compatibleStates = CartesianTopology::createLookup<Dim>(
+        states.size(),
+        [&tokens, &states](size_t aState, size_t direction, size_t bState)
+        {
+            return tokens.at(states[aState])[direction] == tokens.at(states[bState])[direction ^ 1];
+        });
+
+    return grid;
+}
+
+/**
+ * @brief Create a 2D cartesian topology from base tiles, their symmetry classes and tokens.
+ * 
+ * Every base tile becomes one state per distinct variant of its symmetry class, with the weight of the base tile (1 if not specified).
+ * The tokens of the base tile are compared like in createCartTokens, a variant uses the token of the base tile in the direction
+ * that its rotation and reflection move to the compared direction. The tokens are stored once per base tile and the compatible function
+ * permutes the direction instead of storing a row for every variant, so the cost of the tables grows with the base tiles only.
+ * 
+ * @tparam Tile The type of the base tiles.
+ * @tparam Token The type of the tokens.
+ * @tparam Observer The type of the observer of the collapse.
+ * @param size The size of the grid.
+ * @param tiles The symmetry class and the tokens [left, right, up, down] of every base tile.
+ * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
+ * @param weights The weights of the base tiles.
+ * @return The grid topology, whose states are the variants.
+ */
+template <class Tile, class Token, class Observer = NoObserver>
+CartesianGrid<2, Variant<Tile>, Observer> createCartSymmetric(
+    const Vec<2>& size,
+    const std::map<Tile, std::pair<Symmetry, std::array<Token, 4>>>& tiles,
+    const std::array<bool, 2>& periods = {},
+    const std::map<Tile, float>& weights = {})
+{
+    // Direction a quarter turn and a reflection move each direction to
+    constexpr std::array<uint8_t, 4> rotated = { 2, 3, 1, 0 };
+    constexpr std::array<uint8_t, 4> mirrored = { 1, 0, 2, 3 };
+
+    // Tokens of the base tiles as indices into the distinct tokens: [tile][direction]
+    std::vector<Token> distinct;
+    std::vector<uint32_t> edges;
+    edges.reserve(tiles.size() * 4);
+    for (const auto& [tile, entry] : tiles)
+    {
+        for (const Token& token : entry.second)
+        {
+            auto it = std::find(distinct.begin(), distinct.end(), token);
+            edges.push_back(it - distinct.begin());
+            if (it == distinct.end())
+            {
+                distinct.push_back(token);
+            }
+        }
+    }
+
+    // Direction of the base tile each variant shows in each direction: [transform][direction], the transform is mirrored * 4 + rotation
+    std::array<std::array<uint8_t, 4>, 8> sources;
+    for (size_t t = 0; t < 8; t++)
+    {
+        for (uint8_t d = 0; d < 4; d++)
+        {
+            uint8_t moved = t >= 4 ? mirrored[d] : d;
+            for (size_t r = 0; r < t % 4; r++)
+            {
+                moved = rotated[moved];
+            }
+
+            sources[t][moved] = d;
+        }
+    }
+
+    // The variants are generated in the order of their operator<, with the base tile and transform of each state
+    std::vector<Variant<Tile>> states;
+    std::map<Variant<Tile>, float> variantWeights;
+    auto shared = std::make_shared<std::vector<std::pair<uint32_t, uint8_t>>>();
+    size_t base = 0;
+    for (const auto& [tile, entry] : tiles)
     {
-        for (size_t i = 0; i < Dim * 2; i++)
+        Symmetry symmetry = entry.first;
+        size_t count = symmetry == Symmetry::X ? 1 : symmetry == Symmetry::I || symmetry == Symmetry::Diagonal ? 2 : symmetry == Symmetry::F ? 8 : 4;
+        for (size_t t = 0; t < count; t++)
         {
-            size_t j = i ^ 1;
-            if (a.adjacent[i] == &b && b.adjacent[j] == &a)
+            Variant<Tile> variant = { tile, static_cast<uint8_t>(t % 4), t >= 4 };
+            states.push_back(variant);
+            shared->emplace_back(base, t);
+            auto it = weights.find(tile);
+            if (it != weights.end())
             {
-                return tokens.at(aState)[i] == tokens.at(bState)[j];
+                variantWeights[variant] = it->second;
             }
         }
 
-        return false;
+        base++;
+    }
+
+    CartesianGrid<2, Variant<Tile>, Observer> grid = CartesianTopology::createCart<2, Variant<Tile>, Observer>(size, states, periods, variantWeights);
+    grid.compatibleStates =
+        [shared = std::shared_ptr<const std::vector<std::pair<uint32_t, uint8_t>>>(std::move(shared)),
+         edges = std::make_shared<const std::vector<uint32_t>>(std::move(edges)),
+         sources](size_t aState, size_t direction, size_t bState)
+    {
+        auto [aTile, aTransform] = (*shared)[aState];
+        auto [bTile, bTransform] = (*shared)[bState];
+        return (*edges)[aTile * 4 + sources[aTransform][direction]] == (*edges)[bTile * 4 + sources[bTransform][direction ^ 1]];
+    };
+
+    return grid;
+}
+
+/**
+ * @brief Create a cartesian topology with the overlapping model of a sample.
+ * 
+ * Every pattern of n pixels in each dimension is extracted from the sample and deduplicated with a hash index,
+ * the weight of a pattern is the number of times it occurs in the sample.
+ * Two patterns are compatible in a direction if their pixels are equal where they overlap, this is precomputed
+ * by comparing the indices of the deduplicated overlapping slices of the patterns into a direction-aware lookup table.
+ * The pixel of a node is the first pixel of its pattern ( topology.getStates(node)[0][0] once collapsed ).
+ * 
+ * @tparam Dim The number of dimensions.
+ * @tparam Pixel The type of the pixels of the sample, with std::hash and operator<.
+ * @tparam Observer The type of the observer of the collapse.
+ * @param size The size of the grid.
+ * @param sample The pixels of the sample, ordered like the nodes of a grid.
+ * @param sampleSize The size of the sample.
+ * @param n The size of the patterns in each dimension.
+ * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
+ * @param samplePeriods Whether the patterns wrap around the border of the sample (true) or not (false) in each dimension.
+ * @return The grid topology, whose states are the patterns.
+ * @throw std::logic_error If the sample is smaller than the patterns or the size of the sample does not match its pixels.
+ */
+template <size_t Dim, class Pixel, class Observer = NoObserver>
+CartesianGrid<Dim, std::vector<Pixel>, Observer> createCartOverlapping(
+    const Vec<Dim>& size,
+    const std::vector<Pixel>& sample,
+    const Vec<Dim>& sampleSize,
+    size_t n,
+    const std::array<bool, Dim>& periods = {},
+    const std::array<bool, Dim>& samplePeriods = {})
+{
+    using Pattern = std::vector<Pixel>;
+    auto hash = [](const Pattern& pattern)
+    {
+        size_t h = pattern.size();
+        for (const Pixel& pixel : pattern)
+        {
+            h ^= std::hash<Pixel>()(pixel) + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+        }
+
+        return h;
     };
 
+    Vec<Dim> positions, patternSize;
+    size_t pixels = 1, patternPixels = 1, count = 1;
+    for (size_t k = 0; k < Dim; k++)
+    {
+        if (n == 0 || sampleSize[k] < n)
+        {
+            throw std::logic_error("Invalid pattern size");
+        }
+
+        positions[k] = samplePeriods[k] ? sampleSize[k] : sampleSize[k] - n + 1;
+        patternSize[k] = n;
+        pixels *= sampleSize[k];
+        patternPixels *= n;
+        count *= positions[k];
+    }
+
+    if (pixels != sample.size())
+    {
+        throw std::logic_error("Invalid sample size");
+    }
+
+    // Deduplicate the patterns of all positions of the sample
+    std::vector<Pattern> patterns;
+    std::map<Pattern, float> weights;
+    std::unordered_map<Pattern, size_t, decltype(hash)> index(0, hash);
+    Pattern pattern(patternPixels);
+    for (size_t p = 0; p < count; p++)
+    {
+        Vec<Dim> position = CartesianTopology::getCoord<Dim>(p, positions);
+        for (size_t q = 0; q < patternPixels; q++)
+        {
+            Vec<Dim> coord = CartesianTopology::getCoord<Dim>(q, patternSize);
+            for (size_t k = 0; k < Dim; k++)
+            {
+                coord[k] = (position[k] + coord[k]) % sampleSize[k];
+            }
+
+            pattern[q] = sample[CartesianTopology::getIndex<Dim>(coord, sampleSize)];
+        }
+
+        if (index.emplace(pattern, patterns.size()).second)
+        {
+            patterns.push_back(pattern);
+        }
+
+        weights[pattern]++;
+    }
+
+    // Index of the slice without the last (low) and without the first (high) layer of each pattern in each dimension: [k][pattern]
+    std::array<std::vector<size_t>, Dim> lows, highs;
+    std::unordered_map<Pattern, size_t, decltype(hash)> slices(0, hash);
+    for (size_t k = 0; k < Dim; k++)
+    {
+        for (const Pattern& p : patterns)
+        {
+            Pattern low, high;
+            for (size_t q = 0; q < patternPixels; q++)
+            {
+                size_t coord = CartesianTopology::getCoord<Dim>(q, patternSize)[k];
+                if (coord != n - 1)
+                {
+                    low.push_back(p[q]);
+                }
+
+                if (coord != 0)
+                {
+                    high.push_back(p[q]);
+                }
+            }
+
+            lows[k].push_back(slices.emplace(low, slices.size()).first->second);
+            highs[k].push_back(slices.emplace(high, slices.size()).first->second);
+        }
+    }
+
+    CartesianGrid<Dim, Pattern, Observer> grid = CartesianTopology::createCart<Dim, Pattern, Observer>(size, patterns, periods, weights);
+    grid.compatibleStates = CartesianTopology::createLookup<Dim>(
+        patterns.size(),
+        [&lows, &highs](size_t aState, size_t direction, size_t bState)
+        {
+            // The adjacent pattern is shifted by one pixel towards the direction
+            size_t k = direction / 2;
+            return direction % 2 == 0 ? lows[k][aState] == highs[k][bState] : highs[k][aState] == lows[k][bState];
+        });
+
     return grid;
 }
 
+/**
+ * @brief Get the indices of the nodes in a box of a grid.
+ * @tparam Dim The number of dimensions.
+ * @param begin The first coordinate of the box.
+ * @param end The coordinate after the last coordinate of the box in each dimension.
+ * @param size The size of the grid.
+ * @return The indices of the nodes in the box.
+ * @throw std::out_of_range If the box is not inside the grid.
+ */
+template <size_t Dim>
+std::vector<size_t> getRegion(const Vec<Dim>& begin, const Vec<Dim>& end, const Vec<Dim>& size)
+{
+    Vec<Dim> extent;
+    size_t count = 1;
+    for (size_t k = 0; k < Dim; k++)
+    {
+        if (begin[k] > end[k] || end[k] > size[k])
+        {
+            throw std::out_of_range("Region out of range");
+        }
+
+        extent[k] = end[k] - begin[k];
+        count *= extent[k];
+    }
+
+    std::vector<size_t> nodes(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        Vec<Dim> coord = CartesianTopology::getCoord<Dim>(i, extent);
+        for (size_t k = 0; k < Dim; k++)
+        {
+            coord[k] += begin[k];
+        }
+
+        nodes[i] = CartesianTopology::getIndex<Dim>(coord, size);
+    }
+
+    return nodes;
+}
+
+/**
+ * @brief Color the boxes of a grid divided into boxes, so that adjacent boxes never have the same color.
+ *
+ * There are 2 colors in each dimension with more than one box, and 3 in periodic dimensions with an odd number of boxes.
+ *
+ * @tparam Dim The number of dimensions.
+ * @param counts The number of boxes in each dimension.
+ * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
+ * @return The indices of the boxes of each color, ordered like the nodes of a grid of the size counts.
+ */
+template <size_t Dim>
+std::vector<std::vector<size_t>> getColors(const Vec<Dim>& counts, const std::array<bool, Dim>& periods)
+{
+    Vec<Dim> colors;
+    size_t colorCount = 1, boxCount = 1;
+    for (size_t k = 0; k < Dim; k++)
+    {
+        colors[k] = counts[k] == 1 ? 1 : periods[k] && counts[k] % 2 == 1 ? 3 : 2;
+        colorCount *= colors[k];
+        boxCount *= counts[k];
+    }
+
+    std::vector<std::vector<size_t>> boxes(colorCount);
+    for (size_t c = 0; c < boxCount; c++)
+    {
+        Vec<Dim> coord = CartesianTopology::getCoord<Dim>(c, counts), color;
+        for (size_t k = 0; k < Dim; k++)
+        {
+            color[k] = colors[k] == 3 && coord[k] == counts[k] - 1 ? 2 : coord[k] % 2;
+        }
+
+        boxes[CartesianTopology::getIndex<Dim>(color, colors)].push_back(c);
+    }
+
+    return boxes;
+}
+
+/**
+ * @brief Restrict the nodes in a box of a grid to specific states, for example to forbid water above a row.
+ *
+ * The states are removed from the domains once and propagated together, so the constraint costs nothing during the collapse
+ * and the compatible function does not depend on the coordinates. The states are also stored as the masks of the nodes
+ * (see Topology::setMask), so reset() and repair() keep the restriction. A node in several boxes keeps only the states allowed by every box that contains it.
+ *
+ * @tparam Dim The number of dimensions.
+ * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the collapse.
+ * @param grid The grid topology.
+ * @param begin The first coordinate of the box.
+ * @param end The coordinate after the last coordinate of the box in each dimension.
+ * @param states The states the nodes in the box can keep.
+ * @throw std::out_of_range If the box is not inside the grid.
+ * @throw std::logic_error If none of the states of a node is valid.
+ * @throw std::runtime_error If no valid states are found.
+ */
+template <size_t Dim, class State, class Observer>
+void restrictRegion(CartesianGrid<Dim, State, Observer>& grid, const Vec<Dim>& begin, const Vec<Dim>& end, const std::vector<State>& states)
+{
+    std::vector<size_t> nodes = CartesianTopology::getRegion<Dim>(begin, end, grid.graph->getSize());
+    grid.restrictNodes(nodes, states);
+
+    // One mask for every mask the nodes had before, with the states allowed by both
+    std::map<size_t, size_t> masks;
+    for (size_t node : nodes)
+    {
+        auto it = masks.find(grid.getMask(node));
+        if (it == masks.end())
+        {
+            std::vector<State> allowed;
+            for (const State& state : grid.getMaskStates(grid.getMask(node)))
+            {
+                if (std::find(states.begin(), states.end(), state) != states.end())
+                {
+                    allowed.push_back(state);
+                }
+            }
+
+            it = masks.emplace(grid.getMask(node), grid.addMask(allowed)).first;
+        }
+
+        grid.setMask(node, it->second);
+    }
+}
+
+/**
+ * @brief Override the weights of the nodes in a box of a grid, for example for a biome.
+ *
+ * States without a weight in the map have their weight from the weights of the grid.
+ * Gradients are built from several boxes or by setting the tables of the nodes with Topology::setWeightTable.
+ *
+ * @tparam Dim The number of dimensions.
+ * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the collapse.
+ * @param grid The grid topology.
+ * @param begin The first coordinate of the box.
+ * @param end The coordinate after the last coordinate of the box in each dimension.
+ * @param weights The weights of the states in the box.
+ * @return The index of the weight table of the box.
+ * @throw std::out_of_range If the box is not inside the grid.
+ */
+template <size_t Dim, class State, class Observer>
+size_t weightRegion(CartesianGrid<Dim, State, Observer>& grid, const Vec<Dim>& begin, const Vec<Dim>& end, const std::map<State, float>& weights)
+{
+    std::vector<size_t> nodes = CartesianTopology::getRegion<Dim>(begin, end, grid.graph->getSize());
+    size_t table = grid.addWeightTable(weights);
+    for (size_t node : nodes)
+    {
+        grid.setWeightTable(node, table);
+    }
+
+    return table;
+}
+
 }
@@ -0,0 +1,296 @@
+/**
+ * @file ChunkedCollapse.h
+ * @brief Collapsing large grids in chunks on multiple threads.
+ */
+
+#pragma once
+
+#include "CartesianTopology.h"
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+namespace WFC::CartesianTopology
+{
+
+/**
+ * @brief Collapse a grid in chunks on multiple threads.
+ *
+ * The grid is partitioned into chunks that are colored so that adjacent chunks never have the same color
+ * (2 colors per dimension, 3 in periodic dimensions with an odd number of chunks). A last chunk narrower than the margin
+ * is merged into the chunk before it. The colors are collapsed one after another and the chunks of one color concurrently.
+ * Each chunk is collapsed in a window that extends it by a margin: nodes of chunks collapsed before are fixed,
+ * the other nodes of the margin are collapsed but discarded, so the chunk ends with a border the later chunks can continue.
+ * The assembled result is checked against the grid before it is returned.
+ * Each chunk draws from the stream of the seed with the index of the chunk (Random::SplitMix64), so the result does not depend on the number of threads.
+ *
+ * Chunks of tilesets with constraints over long distances can be impossible to continue, in which case the collapse fails.
+ *
+ * The grid is not modified. Its remaining states, compatible functions, weights, weight tables, masks, heuristic, propagation and backtracks are used for every chunk,
+ * so the compatible functions have to be safe to call from multiple threads. A compiled grid shares its tables with the chunks. The chunks have their own observers,
+ * the observer of the grid does not receive their events.
+ *
+ * @tparam Dim The number of dimensions.
+ * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the collapse.
+ * @param grid The grid to collapse.
+ * @param chunk The size of the chunks.
+ * @param seed The seed for the random number generator.
+ * @param threads The number of threads.
+ * @param margin The number of nodes the window extends a chunk in each direction, at least 1 so the window contains the adjacent nodes of the chunk.
+ * @param attempts The number of streams tried for each chunk.
+ * @return The state of every node.
+ * @throw std::logic_error If the chunk size or the margin is zero.
+ * @throw std::runtime_error If no valid states are found for a chunk or the chunks are not compatible.
+ */
+template <size_t Dim, class State, class Observer>
+std::vector<State> collapseChunked(
+    const CartesianGrid<Dim, State, Observer>& grid,
+    const Vec<Dim>& chunk,
+    unsigned int seed = time(NULL),
+    size_t threads = std::thread::hardware_concurrency(),
+    size_t margin = 2,
+    size_t attempts = 8)
+{
+    const Vec<Dim>& size = grid.graph->getSize();
+    const std::array<bool, Dim>& periods = grid.graph->getPeriods();
+    if (margin == 0)
+    {
+        throw std::logic_error("Invalid margin");
+    }
+
+    if (grid.size() == 0)
+    {
+        return {};
+    }
+
+    // Number of chunks and margin in each dimension
+    Vec<Dim> counts, margins;
+    for (size_t k = 0; k < Dim; k++)
+    {
+        if (chunk[k] == 0)
+        {
+            throw std::logic_error("Invalid chunk size");
+        }
+
+        // A window must not reach a chunk of the same color (at least one chunk apart), so every chunk is at least as wide as the margin
+        margins[k] = std::min(margin, chunk[k]);
+        counts[k] = size[k] / chunk[k];
+        if (counts[k] == 0 || size[k] % chunk[k] >= margins[k])
+        {
+            counts[k]++;
+        }
+    }
+
+    std::vector<std::vector<size_t>> chunks = CartesianTopology::getColors<Dim>(counts, periods);
+
+    std::vector<std::optional<State>> result(grid.size());
+    auto collapseChunk = [&](size_t c)
+    {
+        // Window of the chunk in global coordinates, the chunk starts at offset in the window
+        Vec<Dim> coord = CartesianTopology::getCoord<Dim>(c, counts), start, extent, offset, inner;
+        std::array<bool, Dim> localPeriods;
+        for (size_t k = 0; k < Dim; k++)
+        {
+            // The last chunk ends at the end of the grid, a periodic window that would wrap around onto itself covers the whole dimension
+            size_t begin = coord[k] * chunk[k], end = coord[k] + 1 == counts[k] ? size[k] : begin + chunk[k];
+            size_t low = periods[k] ? std::min(margins[k], size[k] - (end - begin)) : std::min(margins[k], begin);
+            size_t high = periods[k] ? std::min(margins[k], size[k] - (end - begin) - low) : std::min(margins[k], size[k] - end);
+            start[k] = begin + size[k] - low;
+            extent[k] = end - begin + low + high;
+            offset[k] = low;
+            inner[k] = end - begin;
+            localPeriods[k] = periods[k] && extent[k] == size[k];
+        }
+
+        CartesianGrid<Dim, State, Observer> local(grid.states, CartesianGraph<Dim>(extent, localPeriods));
+        std::vector<size_t> globals(local.size());
+        for (size_t i = 0; i < local.size(); i++)
+        {
+            Vec<Dim> l = CartesianTopology::getCoord<Dim>(i, extent);
+            for (size_t k = 0; k < Dim; k++)
+            {
+                l[k] = (start[k] + l[k]) % size[k];
+            }
+
+            globals[i] = CartesianTopology::getIndex<Dim>(l, size);
+        }
+
+        local.weights = grid.weights;
+        local.heuristic = grid.heuristic;
+        local.propagation = grid.propagation;
+        local.backtracks = grid.backtracks;
+
+        // The window has the weight tables its nodes use, with the indices of the window
+        std::map<size_t, size_t> tables;
+        for (size_t i = 0; i < local.size(); i++)
+        {
+            size_t table = grid.getWeightTable(globals[i]);
+            if (table != 0)
+            {
+                auto it = tables.find(table);
+                if (it == tables.end())
+                {
+                    it = tables.emplace(table, local.addWeightTable(grid.getWeights(table))).first;
+                }
+
+                local.setWeightTable(i, it->second);
+            }
+        }
+        local.compatibleStates = grid.compatibleStates;
+        if (grid.compatible)
+        {
+            local.compatible = [&grid, &globals](size_t a, const State& aState, size_t direction, size_t b, const State& bState)
+            {
+                return grid.compatible(globals[a], aState, direction, globals[b], bState);
+            };
+        }
+
+        // The window shares the tables of the grid instead of evaluating the compatible function again
+        if (grid.isCompiled())
+        {
+            local.compile(grid);
+        }
+
+        // The window keeps the masks of the grid, so its nodes are restricted like the grid when it is restored
+        std::map<size_t, size_t> masks;
+        for (size_t i = 0; i < local.size(); i++)
+        {
+            size_t mask = grid.getMask(globals[i]);
+            if (mask != 0)
+            {
+                auto it = masks.find(mask);
+                if (it == masks.end())
+                {
+                    it = masks.emplace(mask, local.addMask(grid.getMaskStates(mask))).first;
+                }
+
+                local.setMask(i, it->second);
+            }
+        }
+
+        // Nodes of chunks of other colors are either collapsed before or not written during this color, they are propagated by one wave
+        std::vector<std::pair<size_t, std::vector<State>>> restrictions;
+        for (size_t i = 0; i < local.size(); i++)
+        {
+            const std::optional<State>& state = result[globals[i]];
+            if (state)
+            {
+                if (!local.getStates(i).contains(*state))
+                {
+                    throw std::runtime_error("No valid states");
+                }
+
+                restrictions.emplace_back(i, std::vector<State>{ *state });
+            }
+            else if (grid.getStates(globals[i]).size() != grid.states.size())
+            {
+                restrictions.emplace_back(i, grid.getStates(globals[i]));
+            }
+        }
+
+        local.restrictNodes(restrictions);
+
+        for (size_t attempt = 0; ; attempt++)
+        {
+            CartesianGrid<Dim, State, Observer> topology = local;
+            Random::SplitMix64 randGen(seed, c * attempts + attempt);
+            if (!topology.tryCollapse(randGen))
+            {
+                if (attempt + 1 >= attempts)
+                {
+                    throw std::runtime_error("No valid states");
+                }
+
+                continue;
+            }
+
+            for (size_t i = 0; i < topology.size(); i++)
+            {
+                Vec<Dim> l = CartesianTopology::getCoord<Dim>(i, extent);
+                bool inside = true;
+                for (size_t k = 0; k < Dim; k++)
+                {
+                    inside = inside && l[k] >= offset[k] && l[k] < offset[k] + inner[k];
+                }
+
+                if (inside)
+                {
+                    result[globals[i]] = topology.getStates(i)[0];
+                }
+            }
+
+            return;
+        }
+    };
+
+    threads = std::max<size_t>(threads, 1);
+    for (const std::vector<size_t>& color : chunks)
+    {
+        std::atomic<size_t> next = 0;
+        std::atomic<bool> failed = false;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto work = [&]()
+        {
+            for (size_t i = next++; i < color.size() && !failed; i = next++)
+            {
+                try
+                {
+                    collapseChunk(color[i]);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+
+                    failed = true;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < std::min(threads, color.size()); t++)
+        {
+            workers.emplace_back(work);
+        }
+
+        work();
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    std::vector<State> states;
+    states.reserve(result.size());
+    for (const std::optional<State>& state : result)
+    {
+        states.push_back(*state);
+    }
+
+    if (!grid.isCorrect(states))
+    {
+        throw std::runtime_error("Incompatible chunks");
+    }
+
+    return states;
+}
+
+}
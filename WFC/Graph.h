@@ -0,0 +1,189 @@
+/**
+ * @file Graph.h
+ * @brief Graph class for the topology.
+ *
+ * The graph stores the adjacent nodes of every node.
+ */
+
+#pragma once
+
+#include "Binary.h"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+namespace WFC
+{
+
+/**
+ * @brief Graph class for the topology.
+ *
+ * Nodes are identified by their index. The adjacent nodes of all nodes are stored as 32-bit indices in one contiguous array
+ * (compressed sparse row layout), the position of an adjacent node in the list of a node is its direction.
+ * A direction without an adjacent node contains Graph::none.
+ */
+class Graph
+{
+public:
+    /**
+     * @brief Index of a missing adjacent node.
+     */
+    static constexpr uint32_t none = UINT32_MAX;
+
+    Graph() : offsets(1, 0)
+    {
+    }
+
+    /**
+     * @brief Create a graph where every node has the same number of directions without adjacent nodes.
+     * @param size The number of nodes.
+     * @param degree The number of directions of each node.
+     */
+    Graph(size_t size, size_t degree) : offsets(size + 1), indices(size * degree, Graph::none)
+    {
+        for (size_t i = 0; i <= size; i++)
+        {
+            this->offsets[i] = i * degree;
+        }
+    }
+
+    /**
+     * @brief Add a node with specific adjacent nodes.
+     * @param adjacent The indices of the adjacent nodes, one per direction.
+     * @return The index of the node.
+     */
+    size_t addNode(const std::vector<uint32_t>& adjacent)
+    {
+        this->indices.insert(this->indices.end(), adjacent.begin(), adjacent.end());
+        this->offsets.push_back(this->indices.size());
+        return this->offsets.size() - 2;
+    }
+
+    /**
+     * @brief Get the number of nodes.
+     * @return The number of nodes.
+     */
+    size_t size() const
+    {
+        return this->offsets.size() - 1;
+    }
+
+    /**
+     * @brief Get the number of directions of a node.
+     * @param node The index of the node.
+     * @return The number of directions.
+     */
+    size_t getDegree(size_t node) const
+    {
+        return this->offsets[node + 1] - this->offsets[node];
+    }
+
+    /**
+     * @brief Get the number of directions of all nodes.
+     * @return The number of slots.
+     */
+    size_t getSlots() const
+    {
+        return this->indices.size();
+    }
+
+    /**
+     * @brief Get the index of the first slot of a node.
+     *
+     * The slot of a node in a direction is getSlot(node) + direction.
+     *
+     * @param node The index of the node.
+     * @return The index of the slot.
+     */
+    size_t getSlot(size_t node) const
+    {
+        return this->offsets[node];
+    }
+
+    /**
+     * @brief Get the adjacent node in a specific direction.
+     * @param node The index of the node.
+     * @param direction The direction.
+     * @return The index of the adjacent node or Graph::none.
+     */
+    uint32_t getAdjacent(size_t node, size_t direction) const
+    {
+        return this->indices[this->offsets[node] + direction];
+    }
+
+    /**
+     * @brief Get the adjacent nodes of a node.
+     * @param node The index of the node.
+     * @return Pointer to the first adjacent node, the node has getDegree(node) adjacent nodes.
+     */
+    const uint32_t* getAdjacent(size_t node) const
+    {
+        return this->indices.data() + this->offsets[node];
+    }
+
+    /**
+     * @brief Set the adjacent node in a specific direction.
+     * @param node The index of the node.
+     * @param direction The direction.
+     * @param adjacent The index of the adjacent node or Graph::none.
+     * @throw std::out_of_range If the direction or the adjacent node is out of range.
+     */
+    void setAdjacent(size_t node, size_t direction, size_t adjacent)
+    {
+        if (direction >= this->getDegree(node) || (adjacent != Graph::none && adjacent >= this->size()))
+        {
+            throw std::out_of_range("Adjacent node out of range");
+        }
+
+        this->indices[this->offsets[node] + direction] = adjacent;
+    }
+
+    /**
+     * @brief Write the graph in the binary format of Topology::save.
+     * @param stream The output stream, opened in binary mode.
+     */
+    void save(std::ostream& stream) const
+    {
+        std::vector<uint64_t> offsets(this->offsets.begin(), this->offsets.end());
+        uint64_t counts[2] = { this->size(), this->getSlots() };
+        Binary::write(stream, counts, 2);
+        Binary::write(stream, offsets.data(), offsets.size());
+        Binary::write(stream, this->indices.data(), this->indices.size());
+    }
+
+    /**
+     * @brief Read a graph written by save().
+     * @param reader The reader of the binary data.
+     * @return The graph.
+     * @throw std::runtime_error If the data is not a valid graph.
+     */
+    static Graph load(Binary::Reader& reader)
+    {
+        // The nodes are indexed with 32 bits, Graph::none is not a node
+        const uint64_t* counts = reader.read<uint64_t>(2);
+        if (counts[0] >= Graph::none)
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+
+        const uint64_t* offsets = reader.read<uint64_t>(counts[0] + 1);
+        const uint32_t* indices = reader.read<uint32_t>(counts[1]);
+        Graph graph;
+        graph.offsets.assign(offsets, offsets + counts[0] + 1);
+        graph.indices.assign(indices, indices + counts[1]);
+        if (graph.offsets[0] != 0 || graph.offsets.back() != counts[1] || !std::is_sorted(graph.offsets.begin(), graph.offsets.end()) ||
+            std::any_of(indices, indices + counts[1], [&counts](uint32_t index) { return index != Graph::none && index >= counts[0]; }))
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+
+        return graph;
+    }
+private:
+    std::vector<size_t> offsets;
+    std::vector<uint32_t> indices;
+};
+
+}
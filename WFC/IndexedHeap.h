@@ -0,0 +1,215 @@
+/**
+ * @file IndexedHeap.h
+ * @brief IndexedHeap class for selecting the node with the minimum entropy.
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <memory_resource>
+
+namespace WFC
+{
+
+/**
+ * @brief IndexedHeap class for selecting the node with the minimum entropy.
+ *
+ * The heap is a binary min-heap of node indices ordered by a key.
+ * The position of every node in the heap is stored, so the key of a node can be changed and the node can be removed in O(log n).
+ */
+class IndexedHeap
+{
+public:
+    /**
+     * @brief Create an empty heap.
+     * @param resource The memory resource of the heap.
+     */
+    explicit IndexedHeap(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) : heap(resource), keys(resource), positions(resource)
+    {
+    }
+
+    /**
+     * @brief Remove all nodes and set the number of nodes the heap can contain.
+     * @param size The number of nodes.
+     */
+    void assign(size_t size)
+    {
+        this->heap.clear();
+        this->heap.reserve(size);
+        this->keys.assign(size, 0);
+        this->positions.assign(size, IndexedHeap::none);
+    }
+
+    /**
+     * @brief Check if the heap is empty.
+     * @return True if the heap is empty, false otherwise.
+     */
+    bool empty() const
+    {
+        return this->heap.empty();
+    }
+
+    /**
+     * @brief Check if the heap contains a node.
+     * @param node The index of the node.
+     * @return True if the heap contains the node, false otherwise.
+     */
+    bool contains(size_t node) const
+    {
+        return this->positions[node] != IndexedHeap::none;
+    }
+
+    /**
+     * @brief Get the node with the minimum key.
+     * @return The index of the node.
+     */
+    size_t top() const
+    {
+        return this->heap.front();
+    }
+
+    /**
+     * @brief Get the nodes with the smallest keys in ascending order of their keys without removing them.
+     *
+     * The children of a node in the heap are only visited after the node, so the cost depends on the number of nodes instead of the size of the heap.
+     *
+     * @param count The maximum number of nodes.
+     * @param nodes The nodes, the buffer is cleared first.
+     * @param frontier A scratch buffer for the positions in the heap that are visited next.
+     */
+    void getSmallest(size_t count, std::pmr::vector<size_t>& nodes, std::pmr::vector<size_t>& frontier) const
+    {
+        auto greater = [this](size_t a, size_t b) { return this->keys[this->heap[a]] > this->keys[this->heap[b]]; };
+        nodes.clear();
+        frontier.clear();
+        if (!this->heap.empty())
+        {
+            frontier.push_back(0);
+        }
+
+        while (!frontier.empty() && nodes.size() < count)
+        {
+            std::pop_heap(frontier.begin(), frontier.end(), greater);
+            size_t position = frontier.back();
+            frontier.pop_back();
+            nodes.push_back(this->heap[position]);
+            for (size_t child = 2 * position + 1; child < std::min(2 * position + 3, this->heap.size()); child++)
+            {
+                frontier.push_back(child);
+                std::push_heap(frontier.begin(), frontier.end(), greater);
+            }
+        }
+    }
+
+    /**
+     * @brief Insert a node or change the key of a node.
+     * @param node The index of the node.
+     * @param key The key of the node.
+     */
+    void update(size_t node, double key)
+    {
+        if (!this->contains(node))
+        {
+            this->keys[node] = key;
+            this->positions[node] = this->heap.size();
+            this->heap.push_back(node);
+            this->siftUp(this->heap.size() - 1);
+            return;
+        }
+
+        double oldKey = this->keys[node];
+        this->keys[node] = key;
+        if (key < oldKey)
+        {
+            this->siftUp(this->positions[node]);
+        }
+        else
+        {
+            this->siftDown(this->positions[node]);
+        }
+    }
+
+    /**
+     * @brief Remove a node if the heap contains it.
+     * @param node The index of the node.
+     */
+    void remove(size_t node)
+    {
+        if (!this->contains(node))
+        {
+            return;
+        }
+
+        size_t position = this->positions[node];
+        this->positions[node] = IndexedHeap::none;
+        size_t last = this->heap.back();
+        this->heap.pop_back();
+        if (position == this->heap.size())
+        {
+            return;
+        }
+
+        this->heap[position] = last;
+        this->positions[last] = position;
+        this->siftUp(position);
+        this->siftDown(this->positions[last]);
+    }
+private:
+    static constexpr size_t none = -1;
+
+    std::pmr::vector<size_t> heap;
+    std::pmr::vector<double> keys;
+    std::pmr::vector<size_t> positions;
+
+    void swap(size_t a, size_t b)
+    {
+        std::swap(this->heap[a], this->heap[b]);
+        this->positions[this->heap[a]] = a;
+        this->positions[this->heap[b]] = b;
+    }
+
+    void siftUp(size_t position)
+    {
+        while (position > 0)
+        {
+            size_t parent = (position - 1) / 2;
+            if (this->keys[this->heap[parent]] <= this->keys[this->heap[position]])
+            {
+                break;
+            }
+
+            this->swap(parent, position);
+            position = parent;
+        }
+    }
+
+    void siftDown(size_t position)
+    {
+        while (true)
+        {
+            size_t min = position;
+            size_t left = 2 * position + 1, right = left + 1;
+            if (left < this->heap.size() && this->keys[this->heap[left]] < this->keys[this->heap[min]])
+            {
+                min = left;
+            }
+
+            if (right < this->heap.size() && this->keys[this->heap[right]] < this->keys[this->heap[min]])
+            {
+                min = right;
+            }
+
+            if (min == position)
+            {
+                break;
+            }
+
+            this->swap(min, position);
+            position = min;
+        }
+    }
+};
+
+}
@@ -0,0 +1,243 @@
+/**
+ * @file Kernels.h
+ * @brief Vectorized kernels for propagating bitset domains.
+ *
+ * The kernels are implemented with AVX2 on x86-64 (selected at runtime if the processor supports it),
+ * with NEON on ARM64 and without SIMD instructions otherwise. Defining WFC_NO_SIMD disables the SIMD kernels.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(WFC_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define WFC_KERNELS_AVX2
+#include <immintrin.h>
+#elif !defined(WFC_NO_SIMD) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#define WFC_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace WFC::Kernels
+{
+
+/**
+ * @brief Result of intersecting a domain with the allowed states.
+ */
+enum class Intersection
+{
+    /**
+     * @brief All states of the domain are allowed.
+     */
+    Unchanged,
+
+    /**
+     * @brief Some but not all states of the domain are not allowed.
+     */
+    Changed,
+
+    /**
+     * @brief No state of the domain is allowed.
+     */
+    Empty,
+};
+
+/**
+ * @brief Kernels of one instruction set.
+ */
+struct Functions
+{
+    /**
+     * @brief Set the bits of a bitset that are set in another bitset ( a |= b ).
+     */
+    void (*unite)(uint64_t* a, const uint64_t* b, size_t count);
+
+    /**
+     * @brief Check if all bits of b are set in a.
+     */
+    bool (*covers)(const uint64_t* a, const uint64_t* b, size_t count);
+
+    /**
+     * @brief Get the states of a domain that are not allowed ( removed = domain & ~allowed ).
+     */
+    Intersection (*intersect)(uint64_t* removed, const uint64_t* domain, const uint64_t* allowed, size_t count);
+};
+
+namespace Scalar
+{
+
+inline void unite(uint64_t* a, const uint64_t* b, size_t count)
+{
+    for (size_t w = 0; w < count; w++)
+    {
+        a[w] |= b[w];
+    }
+}
+
+inline bool covers(const uint64_t* a, const uint64_t* b, size_t count)
+{
+    uint64_t missing = 0;
+    for (size_t w = 0; w < count; w++)
+    {
+        missing |= b[w] & ~a[w];
+    }
+
+    return missing == 0;
+}
+
+inline Intersection intersect(uint64_t* removed, const uint64_t* domain, const uint64_t* allowed, size_t count)
+{
+    uint64_t anyRemoved = 0, anyKept = 0;
+    for (size_t w = 0; w < count; w++)
+    {
+        removed[w] = domain[w] & ~allowed[w];
+        anyRemoved |= removed[w];
+        anyKept |= domain[w] & allowed[w];
+    }
+
+    return anyKept == 0 ? Intersection::Empty : anyRemoved != 0 ? Intersection::Changed : Intersection::Unchanged;
+}
+
+}
+
+#if defined(WFC_KERNELS_AVX2)
+namespace AVX2
+{
+
+__attribute__((target("avx2"))) inline void unite(uint64_t* a, const uint64_t* b, size_t count)
+{
+    size_t w = 0;
+    for (; w + 4 <= count; w += 4)
+    {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + w));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + w));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a + w), _mm256_or_si256(va, vb));
+    }
+
+    Scalar::unite(a + w, b + w, count - w);
+}
+
+__attribute__((target("avx2"))) inline bool covers(const uint64_t* a, const uint64_t* b, size_t count)
+{
+    size_t w = 0;
+    __m256i missing = _mm256_setzero_si256();
+    for (; w + 4 <= count; w += 4)
+    {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + w));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + w));
+        missing = _mm256_or_si256(missing, _mm256_andnot_si256(va, vb));
+    }
+
+    return _mm256_testz_si256(missing, missing) && Scalar::covers(a + w, b + w, count - w);
+}
+
+__attribute__((target("avx2"))) inline Intersection intersect(uint64_t* removed, const uint64_t* domain, const uint64_t* allowed, size_t count)
+{
+    size_t w = 0;
+    __m256i anyRemoved = _mm256_setzero_si256(), anyKept = _mm256_setzero_si256();
+    for (; w + 4 <= count; w += 4)
+    {
+        __m256i vd = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(domain + w));
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(allowed + w));
+        __m256i vr = _mm256_andnot_si256(va, vd);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(removed + w), vr);
+        anyRemoved = _mm256_or_si256(anyRemoved, vr);
+        anyKept = _mm256_or_si256(anyKept, _mm256_and_si256(vd, va));
+    }
+
+    uint64_t tailRemoved = 0, tailKept = 0;
+    for (; w < count; w++)
+    {
+        removed[w] = domain[w] & ~allowed[w];
+        tailRemoved |= removed[w];
+        tailKept |= domain[w] & allowed[w];
+    }
+
+    bool kept = !_mm256_testz_si256(anyKept, anyKept) || tailKept != 0;
+    bool changed = !_mm256_testz_si256(anyRemoved, anyRemoved) || tailRemoved != 0;
+    return !kept ? Intersection::Empty : changed ? Intersection::Changed : Intersection::Unchanged;
+}
+
+}
+#endif
+
+#if defined(WFC_KERNELS_NEON)
+namespace NEON
+{
+
+inline void unite(uint64_t* a, const uint64_t* b, size_t count)
+{
+    size_t w = 0;
+    for (; w + 2 <= count; w += 2)
+    {
+        vst1q_u64(a + w, vorrq_u64(vld1q_u64(a + w), vld1q_u64(b + w)));
+    }
+
+    Scalar::unite(a + w, b + w, count - w);
+}
+
+inline bool covers(const uint64_t* a, const uint64_t* b, size_t count)
+{
+    size_t w = 0;
+    uint64x2_t missing = vdupq_n_u64(0);
+    for (; w + 2 <= count; w += 2)
+    {
+        missing = vorrq_u64(missing, vbicq_u64(vld1q_u64(b + w), vld1q_u64(a + w)));
+    }
+
+    return (vgetq_lane_u64(missing, 0) | vgetq_lane_u64(missing, 1)) == 0 && Scalar::covers(a + w, b + w, count - w);
+}
+
+inline Intersection intersect(uint64_t* removed, const uint64_t* domain, const uint64_t* allowed, size_t count)
+{
+    size_t w = 0;
+    uint64x2_t anyRemoved = vdupq_n_u64(0), anyKept = vdupq_n_u64(0);
+    for (; w + 2 <= count; w += 2)
+    {
+        uint64x2_t vd = vld1q_u64(domain + w), va = vld1q_u64(allowed + w);
+        uint64x2_t vr = vbicq_u64(vd, va);
+        vst1q_u64(removed + w, vr);
+        anyRemoved = vorrq_u64(anyRemoved, vr);
+        anyKept = vorrq_u64(anyKept, vandq_u64(vd, va));
+    }
+
+    uint64_t tailRemoved = 0, tailKept = 0;
+    for (; w < count; w++)
+    {
+        removed[w] = domain[w] & ~allowed[w];
+        tailRemoved |= removed[w];
+        tailKept |= domain[w] & allowed[w];
+    }
+
+    bool kept = (vgetq_lane_u64(anyKept, 0) | vgetq_lane_u64(anyKept, 1) | tailKept) != 0;
+    bool changed = (vgetq_lane_u64(anyRemoved, 0) | vgetq_lane_u64(anyRemoved, 1) | tailRemoved) != 0;
+    return !kept ? Intersection::Empty : changed ? Intersection::Changed : Intersection::Unchanged;
+}
+
+}
+#endif
+
+/**
+ * @brief Get the kernels of the best instruction set supported by the processor.
+ * @return The kernels, selected once.
+ */
+inline const Functions& get()
+{
+    static const Functions functions = []()
+    {
+#if defined(WFC_KERNELS_AVX2)
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return Functions{ AVX2::unite, AVX2::covers, AVX2::intersect };
+        }
+#elif defined(WFC_KERNELS_NEON)
+        return Functions{ NEON::unite, NEON::covers, NEON::intersect };
+#endif
+        return Functions{ Scalar::unite, Scalar::covers, Scalar::intersect };
+    }();
+
+    return functions;
+}
+
+}
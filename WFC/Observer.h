@@ -0,0 +1,231 @@
+/**
+ * @file Observer.h
+ * @brief Observers of the events of a collapse.
+ *
+ * The observer is a template parameter of the topology, so the events of NoObserver compile to nothing.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+namespace WFC
+{
+
+/**
+ * @brief Phase of a collapse measured by an observer.
+ */
+enum class Phase
+{
+    /**
+     * @brief Select the next node and its state.
+     */
+    Selection,
+
+    /**
+     * @brief Propagate the removed states to the adjacent nodes.
+     */
+    Propagation,
+
+    /**
+     * @brief Undo the decisions after a contradiction.
+     */
+    Backtracking,
+
+    /**
+     * @brief Compile the compatible function.
+     */
+    Compilation,
+};
+
+/**
+ * @brief Observer that ignores all events.
+ *
+ * An observer is a type with the same member functions, which the topology calls as the collapse advances.
+ */
+struct NoObserver
+{
+    /**
+     * @brief Called when a phase begins.
+     * @param phase The phase.
+     */
+    void onBegin(Phase /* phase */) {}
+
+    /**
+     * @brief Called when a phase ends.
+     * @param phase The phase.
+     */
+    void onEnd(Phase /* phase */) {}
+
+    /**
+     * @brief Called for every evaluation of the compatible function.
+     */
+    void onCompatible() {}
+
+    /**
+     * @brief Called for every state removed from a node.
+     * @param node The index of the node.
+     * @param state The index of the state in the state table.
+     */
+    void onRemove(size_t /* node */, size_t /* state */) {}
+
+    /**
+     * @brief Called for every node that is reduced by its adjacent nodes (by one adjacent node with Propagation::Masks).
+     * @param node The index of the node.
+     */
+    void onReduce(size_t /* node */) {}
+
+    /**
+     * @brief Called at the end of a propagation.
+     * @param visited The number of nodes whose adjacent nodes were reduced (or removals that were propagated after compile()).
+     */
+    void onWave(size_t /* visited */) {}
+
+    /**
+     * @brief Called for every node the collapse decides, before the state is propagated.
+     * @param node The index of the node.
+     * @param state The index of the state in the state table.
+     */
+    void onStep(size_t /* node */, size_t /* state */) {}
+
+    /**
+     * @brief Called for every decision that is undone after a contradiction.
+     * @param node The index of the node.
+     * @param state The index of the state, which is removed from the node instead.
+     */
+    void onBacktrack(size_t /* node */, size_t /* state */) {}
+
+    /**
+     * @brief Called for every contradiction.
+     */
+    void onContradiction() {}
+};
+
+/**
+ * @brief Observer that counts the events and measures the time of each phase.
+ *
+ * The statistics accumulate over all operations on the topology until they are reset.
+ */
+struct Stats : NoObserver
+{
+    /**
+     * @brief Number of evaluations of the compatible function.
+     */
+    uint64_t compatibleCalls = 0;
+
+    /**
+     * @brief Number of removed states.
+     */
+    uint64_t removals = 0;
+
+    /**
+     * @brief Number of nodes reduced by their adjacent nodes.
+     */
+    uint64_t reductions = 0;
+
+    /**
+     * @brief Number of propagations and total number of nodes (or removals) they visited.
+     */
+    uint64_t waves = 0;
+    uint64_t visited = 0;
+
+    /**
+     * @brief Largest number of nodes (or removals) visited by one propagation.
+     */
+    uint64_t maxVisited = 0;
+
+    /**
+     * @brief Number of decisions of the collapses.
+     */
+    uint64_t steps = 0;
+
+    /**
+     * @brief Number of undone decisions.
+     */
+    uint64_t backtracks = 0;
+
+    /**
+     * @brief Number of contradictions.
+     */
+    uint64_t contradictions = 0;
+
+    /**
+     * @brief Time spent in each phase in seconds, indexed by the phase.
+     */
+    std::array<double, 4> seconds = {};
+
+    /**
+     * @brief Called for every decision if defined, for example to export the progress of a collapse.
+     */
+    std::function<void(size_t node, size_t state)> step;
+
+    /**
+     * @brief Reset the statistics, the step function is kept.
+     */
+    void reset()
+    {
+        std::function<void(size_t, size_t)> step = std::move(this->step);
+        *this = Stats();
+        this->step = std::move(step);
+    }
+
+    void onBegin(Phase phase)
+    {
+        this->begins[static_cast<size_t>(phase)] = std::chrono::steady_clock::now();
+    }
+
+    void onEnd(Phase phase)
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - this->begins[static_cast<size_t>(phase)];
+        this->seconds[static_cast<size_t>(phase)] += elapsed.count();
+    }
+
+    void onCompatible()
+    {
+        this->compatibleCalls++;
+    }
+
+    void onRemove(size_t, size_t)
+    {
+        this->removals++;
+    }
+
+    void onReduce(size_t)
+    {
+        this->reductions++;
+    }
+
+    void onWave(size_t visited)
+    {
+        this->waves++;
+        this->visited += visited;
+        this->maxVisited = std::max<uint64_t>(this->maxVisited, visited);
+    }
+
+    void onStep(size_t node, size_t state)
+    {
+        this->steps++;
+        if (this->step)
+        {
+            this->step(node, state);
+        }
+    }
+
+    void onBacktrack(size_t, size_t)
+    {
+        this->backtracks++;
+    }
+
+    void onContradiction()
+    {
+        this->contradictions++;
+    }
+private:
+    std::array<std::chrono::steady_clock::time_point, 4> begins = {};
+};
+
+}
@@ -0,0 +1,457 @@
+/**
+ * @file ParallelCollapse.h
+ * @brief Collapsing large grids with data-parallel passes over bitset domains.
+ */
+
+#pragma once
+
+#include "Bitset.h"
+#include "Random.h"
+#include "Kernels.h"
+#include "Workers.h"
+#include "CartesianTopology.h"
+
+#include <array>
+#include <cmath>
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+namespace WFC::CartesianTopology
+{
+
+/**
+ * @brief Collapse a grid with data-parallel passes on multiple threads.
+ *
+ * The domains are stored as flat bitsets and every pass processes many nodes independently, like a kernel on a GPU.
+ * A propagation pass intersects the domain of every node next to a node changed by the previous pass with the states allowed
+ * by its Dim * 2 adjacent nodes, reading only the domains of the previous pass, until no domain changes.
+ * A decision pass partitions the grid into blocks, colored so that adjacent blocks never have the same color,
+ * and collapses the node with the lowest entropy of every block of one color at once, so the decisions of a pass are at least a block apart.
+ * The random values only depend on the seed, the node and the pass, so the result does not depend on the number of threads.
+ *
+ * The grid is not modified. Its remaining states, compatible functions, weights, weight tables and heuristic are used,
+ * the compatibility of two states must only depend on the direction (see Topology::compile). The grid can be created with any helper,
+ * such as createCartTokens or createCartAdjacent. There is no backtracking, a node left without states resets the nodes around it
+ * to their states in the grid and the collapse continues. The radius of the reset grows with the contradictions in its block,
+ * so tilesets that contradict often are better collapsed by Topology::collapse with backtracks.
+ *
+ * @tparam Dim The number of dimensions.
+ * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the grid, which does not receive events.
+ * @param grid The grid to collapse.
+ * @param seed The seed for the random number generator.
+ * @param threads The number of threads.
+ * @param block The size of the blocks in each dimension.
+ * @param repairs The maximum number of resets.
+ * @return The state of every node.
+ * @throw std::logic_error If the block size is zero.
+ * @throw std::runtime_error If no valid states are found with the resets.
+ */
+template <size_t Dim, class State, class Observer>
+std::vector<State> collapseParallel(
+    const CartesianGrid<Dim, State, Observer>& grid,
+    unsigned int seed = time(NULL),
+    size_t threads = std::thread::hardware_concurrency(),
+    size_t block = 8,
+    size_t repairs = 4096)
+{
+    constexpr size_t directions = Dim * 2;
+    const CartesianGraph<Dim>& graph = *grid.graph;
+    const Vec<Dim>& size = graph.getSize();
+    const std::array<bool, Dim>& periods = graph.getPeriods();
+    const Kernels::Functions& kernels = Kernels::get();
+    size_t count = grid.states.size(), words = Bitset::getWords(count), nodes = grid.size();
+    if (block == 0)
+    {
+        throw std::logic_error("Invalid block size");
+    }
+
+    if (nodes == 0)
+    {
+        return {};
+    }
+
+    // States of a node compatible with each state of its adjacent node in each direction, from the rules of the grid: [d][adjacent state][word]
+    std::vector<uint64_t> gridRules = grid.getRules();
+    std::vector<uint64_t> rules(directions * count * words, 0), supported(directions * words, 0);
+    for (size_t d = 0; d < directions && d * count * words < gridRules.size(); d++)
+    {
+        for (size_t sa = 0; sa < count; sa++)
+        {
+            Bitset::forEach(&gridRules[(d * count + sa) * words], words, [&rules, d, count, words, sa](size_t sb) { Bitset::set(&rules[(d * count + sb) * words], sa); });
+        }
+
+        // The states allowed by an adjacent node that has all states
+        for (size_t sb = 0; sb < count; sb++)
+        {
+            kernels.unite(&supported[d * words], &rules[(d * count + sb) * words], words);
+        }
+    }
+
+    gridRules = std::vector<uint64_t>();
+
+    // Weight w and w * log(w) of each state in each weight table used by the grid: [table][state]
+    std::vector<uint32_t> tables(nodes);
+    size_t tableCount = 1;
+    for (size_t i = 0; i < nodes; i++)
+    {
+        tables[i] = grid.getWeightTable(i);
+        tableCount = std::max<size_t>(tableCount, tables[i] + 1);
+    }
+
+    std::vector<double> weights(tableCount * count), weightLogs(tableCount * count);
+    for (size_t t = 0; t < tableCount; t++)
+    {
+        grid.getResolvedWeights(t, &weights[t * count], &weightLogs[t * count]);
+    }
+
+    // Blocks of each color, and the nodes of each block in order
+    Vec<Dim> blocks;
+    size_t blockCount = 1;
+    for (size_t k = 0; k < Dim; k++)
+    {
+        blocks[k] = (size[k] + block - 1) / block;
+        blockCount *= blocks[k];
+    }
+
+    std::vector<std::vector<size_t>> colored = CartesianTopology::getColors<Dim>(blocks, periods);
+    size_t colorCount = colored.size();
+    std::vector<uint32_t> blockOf(nodes), offsets(blockCount + 1, 0), order(nodes);
+    for (size_t i = 0; i < nodes; i++)
+    {
+        Vec<Dim> coord = CartesianTopology::getCoord<Dim>(i, size);
+        for (size_t k = 0; k < Dim; k++)
+        {
+            coord[k] /= block;
+        }
+
+        blockOf[i] = CartesianTopology::getIndex<Dim>(coord, blocks);
+        offsets[blockOf[i] + 1]++;
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < nodes; i++)
+    {
+        order[cursors[blockOf[i]]++] = i;
+    }
+
+    blockOf = std::vector<uint32_t>();
+
+    // The threads are started once and run every pass, small passes run on the calling thread only
+    Workers workers(threads);
+    threads = workers.size();
+    auto forEach = [&workers](size_t items, const std::function<void(size_t begin, size_t end, size_t thread)>& function)
+    {
+        workers.forEach(items, 1024, function);
+    };
+
+    std::vector<std::vector<uint32_t>> updatedNodes(threads), emptyNodes(threads);
+    std::vector<std::vector<uint64_t>> updatedDomains(threads);
+    std::vector<std::pmr::vector<size_t>> candidates(threads);
+    std::vector<std::pmr::vector<double>> cumulativeWeights(threads);
+    std::vector<uint64_t> domains(nodes * words);
+    std::vector<uint32_t> sizes(nodes);
+    std::vector<double> noise(nodes);
+    std::vector<uint32_t> changed(nodes), empties;
+    for (size_t i = 0; i < nodes; i++)
+    {
+        const uint64_t* domain = grid.getStates(i).getWords();
+        std::copy(domain, domain + words, &domains[i * words]);
+        sizes[i] = Bitset::count(domain, words);
+        Random::SplitMix64 randGen(seed);
+        randGen.discard(i);
+        noise[i] = Random::canonical(randGen);
+        changed[i] = i;
+    }
+
+    // Reduce the nodes next to the changed nodes until no domain changes, returns false if nodes are left without states
+    std::vector<std::atomic<uint32_t>> stamps(nodes);
+    uint32_t pass = 0;
+    auto propagate = [&]()
+    {
+        while (!changed.empty())
+        {
+            if (++pass == 0)
+            {
+                std::for_each(stamps.begin(), stamps.end(), [](std::atomic<uint32_t>& stamp) { stamp = 0; });
+                pass = 1;
+            }
+
+            for (size_t t = 0; t < threads; t++)
+            {
+                updatedNodes[t].clear();
+                updatedDomains[t].clear();
+                emptyNodes[t].clear();
+            }
+
+            // A node is reduced at most once per pass, by the thread that stamps it first
+            forEach(
+                changed.size(),
+                [&](size_t begin, size_t end, size_t thread)
+                {
+                    std::vector<uint64_t> domain(words), allowed(words);
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        for (size_t d = 0; d < directions; d++)
+                        {
+                            size_t a = graph.getAdjacent(changed[i], d);
+                            if (a == CartesianGraph<Dim>::none || stamps[a].exchange(pass, std::memory_order_relaxed) == pass)
+                            {
+                                continue;
+                            }
+
+                            const uint64_t* current = &domains[a * words];
+                            std::copy(current, current + words, domain.begin());
+                            for (size_t e = 0; e < directions; e++)
+                            {
+                                size_t b = graph.getAdjacent(a, e);
+                                if (b == CartesianGraph<Dim>::none)
+                                {
+                                    continue;
+                                }
+
+                                // Union of the states compatible with a state of b, stopping early once it contains the domain
+                                const uint64_t* mask = &supported[e * words];
+                                if (sizes[b] != count)
+                                {
+                                    std::fill(allowed.begin(), allowed.end(), 0);
+                                    size_t united = 0;
+                                    bool covered = false;
+                                    Bitset::forEach(
+                                        &domains[b * words],
+                                        words,
+                                        [&](size_t sb)
+                                        {
+                                            if (!covered)
+                                            {
+                                                kernels.unite(allowed.data(), &rules[(e * count + sb) * words], words);
+                                                covered = ++united % 8 == 0 && kernels.covers(allowed.data(), domain.data(), words);
+                                            }
+                                        });
+
+                                    mask = allowed.data();
+                                }
+
+                                for (size_t w = 0; w < words; w++)
+                                {
+                                    domain[w] &= mask[w];
+                                }
+                            }
+
+                            if (Bitset::count(domain.data(), words) == 0)
+                            {
+                                emptyNodes[thread].push_back(a);
+                            }
+                            else if (!std::equal(domain.begin(), domain.end(), current))
+                            {
+                                updatedNodes[thread].push_back(a);
+                                updatedDomains[thread].insert(updatedDomains[thread].end(), domain.begin(), domain.end());
+                            }
+                        }
+                    }
+                });
+
+            // The domains of the pass are written after all nodes of the pass are reduced
+            changed.clear();
+            for (size_t t = 0; t < threads; t++)
+            {
+                for (size_t i = 0; i < updatedNodes[t].size(); i++)
+                {
+                    size_t a = updatedNodes[t][i];
+                    std::copy(&updatedDomains[t][i * words], &updatedDomains[t][i * words] + words, &domains[a * words]);
+                    sizes[a] = Bitset::count(&domains[a * words], words);
+                    changed.push_back(a);
+                }
+
+                empties.insert(empties.end(), emptyNodes[t].begin(), emptyNodes[t].end());
+            }
+
+            if (!empties.empty())
+            {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    // Reset the nodes around the nodes without states to their states in the grid, the radius grows with the contradictions in a block
+    std::vector<uint8_t> done(blockCount, 0), heat(blockCount, 0);
+    auto getBlock = [&](const Vec<Dim>& coord)
+    {
+        Vec<Dim> blockCoord;
+        for (size_t k = 0; k < Dim; k++)
+        {
+            blockCoord[k] = coord[k] / block;
+        }
+
+        return CartesianTopology::getIndex<Dim>(blockCoord, blocks);
+    };
+
+    size_t repaired = 0;
+    auto repair = [&]()
+    {
+        if (repaired++ == repairs)
+        {
+            throw std::runtime_error("No valid states");
+        }
+
+        // The nodes are sorted, so the radii do not depend on the number of threads
+        std::sort(empties.begin(), empties.end());
+        for (size_t node : empties)
+        {
+            Vec<Dim> center = CartesianTopology::getCoord<Dim>(node, size), extent;
+            size_t radius = 1 + heat[getBlock(center)];
+            heat[getBlock(center)] = std::min(heat[getBlock(center)] + 1, 255);
+            size_t boxCount = 1;
+            for (size_t k = 0; k < Dim; k++)
+            {
+                extent[k] = radius * 2 + 1;
+                boxCount *= extent[k];
+            }
+
+            for (size_t i = 0; i < boxCount; i++)
+            {
+                Vec<Dim> coord = CartesianTopology::getCoord<Dim>(i, extent);
+                bool inside = true;
+                for (size_t k = 0; k < Dim; k++)
+                {
+                    coord[k] = center[k] + size[k] * radius + coord[k] - radius;
+                    inside = inside && (periods[k] || (coord[k] >= size[k] * radius && coord[k] < size[k] * (radius + 1)));
+                    coord[k] %= size[k];
+                }
+
+                if (inside)
+                {
+                    size_t a = CartesianTopology::getIndex<Dim>(coord, size);
+                    const uint64_t* domain = grid.getStates(a).getWords();
+                    std::copy(domain, domain + words, &domains[a * words]);
+                    sizes[a] = Bitset::count(domain, words);
+                    done[getBlock(coord)] = 0;
+                    changed.push_back(a);
+                }
+            }
+        }
+
+        empties.clear();
+    };
+
+    // Collapse the node with the lowest entropy of every block of a color, nodes without states with a positive weight are added to the empty nodes
+    auto decide = [&](const std::vector<size_t>& colorBlocks, size_t round)
+    {
+        std::vector<std::pair<size_t, size_t>> decisions(colorBlocks.size(), { nodes, count });
+        forEach(
+            colorBlocks.size(),
+            [&](size_t begin, size_t end, size_t thread)
+            {
+                for (size_t j = begin; j < end; j++)
+                {
+                    size_t c = colorBlocks[j];
+                    if (done[c])
+                    {
+                        continue;
+                    }
+
+                    size_t best = nodes;
+                    double bestEntropy = std::numeric_limits<double>::infinity();
+                    for (size_t k = offsets[c]; k < offsets[c + 1]; k++)
+                    {
+                        size_t a = order[k];
+                        if (sizes[a] <= 1)
+                        {
+                            continue;
+                        }
+
+                        double entropy = sizes[a] + noise[a];
+                        if (grid.heuristic == Heuristic::Entropy)
+                        {
+                            double sum = 0, sumLogs = 0;
+                            Bitset::forEach(&domains[a * words], words, [&](size_t s) { sum += weights[tables[a] * count + s]; sumLogs += weightLogs[tables[a] * count + s]; });
+                            entropy = CartesianGrid<Dim, State, Observer>::getEntropy(sum, sumLogs, noise[a]);
+                        }
+
+                        if (entropy < bestEntropy)
+                        {
+                            best = a;
+                            bestEntropy = entropy;
+                        }
+                    }
+
+                    if (best == nodes)
+                    {
+                        done[c] = 1;
+                        continue;
+                    }
+
+                    Random::SplitMix64 randGen(seed);
+                    randGen.discard((round + 1) * nodes + best);
+                    size_t state = CartesianGrid<Dim, State, Observer>::sampleState(
+                        &domains[best * words],
+                        words,
+                        &weights[tables[best] * count],
+                        randGen,
+                        candidates[thread],
+                        cumulativeWeights[thread],
+                        [](size_t) { return true; });
+
+                    decisions[j] = { best, state };
+                }
+            });
+
+        size_t decided = 0;
+        for (auto [a, state] : decisions)
+        {
+            if (a != nodes && state == Result::none)
+            {
+                empties.push_back(a);
+            }
+            else if (a != nodes)
+            {
+                std::fill(&domains[a * words], &domains[a * words] + words, 0);
+                Bitset::set(&domains[a * words], state);
+                sizes[a] = 1;
+                changed.push_back(a);
+                decided++;
+            }
+        }
+
+        return decided;
+    };
+
+    // The grid is collapsed when no color has an undecided node
+    for (size_t round = 0, idle = 0; idle < colorCount; round++)
+    {
+        size_t before = repaired;
+        while (!propagate())
+        {
+            repair();
+        }
+
+        size_t decided = decide(colored[round % colorCount], round);
+        if (!empties.empty())
+        {
+            repair();
+        }
+
+        idle = decided == 0 && repaired == before ? idle + 1 : 0;
+    }
+
+    std::vector<State> result;
+    result.reserve(nodes);
+    for (size_t i = 0; i < nodes; i++)
+    {
+        result.push_back(grid.states[Bitset::first(&domains[i * words], words)]);
+    }
+
+    return result;
+}
+
+}
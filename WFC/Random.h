@@ -0,0 +1,108 @@
+/**
+ * @file Random.h
+ * @brief Reproducible random number generation for the collapse.
+ *
+ * The values only depend on the seed, not on the platform or the standard library,
+ * so a collapse with a specific seed and Heuristic::Count gives the same result everywhere.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace WFC::Random
+{
+
+/**
+ * @brief Mix the bits of a value with the splitmix64 finalizer.
+ * @param x The value.
+ * @return The mixed value, consecutive values give unrelated results.
+ */
+inline uint64_t mix(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Counter-based random number generator.
+ *
+ * The n-th value is the mixed sum of a key and n times the golden ratio, so the generator is 16 bytes, cheap to copy,
+ * can skip values in constant time and can be split into independent streams, for example one per chunk of a collapse.
+ * It satisfies the requirements of a uniform random bit generator, so it can be used with the standard distributions.
+ */
+class SplitMix64
+{
+public:
+    using result_type = uint64_t;
+
+    /**
+     * @brief Create a generator.
+     * @param seed The seed.
+     * @param stream The index of the stream, generators with the same seed and different streams give unrelated values.
+     */
+    explicit SplitMix64(uint64_t seed = 0, uint64_t stream = 0) : key(Random::mix(seed + SplitMix64::increment * (stream + 1)))
+    {
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return UINT64_MAX;
+    }
+
+    /**
+     * @brief Generate the next value.
+     * @return The value.
+     */
+    result_type operator()()
+    {
+        return Random::mix(this->key + SplitMix64::increment * ++this->counter);
+    }
+
+    /**
+     * @brief Skip values.
+     * @param count The number of values to skip.
+     */
+    void discard(uint64_t count)
+    {
+        this->counter += count;
+    }
+private:
+    static constexpr uint64_t increment = 0x9e3779b97f4a7c15;
+
+    uint64_t key;
+    uint64_t counter = 0;
+};
+
+/**
+ * @brief Generate a uniform value in [0, 1) from the bits of a generator.
+ *
+ * Unlike std::uniform_real_distribution, the value is specified exactly: the 53 high bits of a 64-bit value,
+ * taken from one call of a 64-bit generator or two calls of a 32-bit generator (such as std::mt19937).
+ *
+ * @tparam Engine The type of the generator, which generates 32 or 64 random bits.
+ * @param engine The generator.
+ * @return The value.
+ */
+template <class Engine>
+double canonical(Engine& engine)
+{
+    constexpr uint64_t range = Engine::max() - Engine::min();
+    static_assert(range == UINT32_MAX || range == UINT64_MAX, "The generator has to generate 32 or 64 random bits");
+
+    uint64_t bits = engine() - Engine::min();
+    if constexpr (range == UINT32_MAX)
+    {
+        bits = bits << 32 | (engine() - Engine::min());
+    }
+
+    return (bits >> 11) * 0x1.0p-53;
+}
+
+}
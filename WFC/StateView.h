@@ -0,0 +1,200 @@
+/**
+ * @file StateView.h
+ * @brief StateView class for reading the states of a node.
+ *
+ * A state view maps the bitset domain of a node onto the state table of the topology.
+ */
+
+#pragma once
+
+#include "Bitset.h"
+
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+
+namespace WFC
+{
+
+/**
+ * @brief StateView class for reading the states of a node.
+ *
+ * The view does not own any data and is invalidated when the topology is modified.
+ *
+ * @tparam State The type of the states.
+ */
+template <class State>
+class StateView
+{
+public:
+    /**
+     * @brief Forward iterator over the states of the view.
+     */
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = State;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const State*;
+        using reference = const State&;
+
+        Iterator(const std::vector<State>* table, const uint64_t* words, size_t index) : table(table), words(words), index(index)
+        {
+            this->skip();
+        }
+
+        reference operator*() const
+        {
+            return (*this->table)[this->index];
+        }
+
+        pointer operator->() const
+        {
+            return &(*this->table)[this->index];
+        }
+
+        Iterator& operator++()
+        {
+            this->index++;
+            this->skip();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator it = *this;
+            ++*this;
+            return it;
+        }
+
+        bool operator==(const Iterator& other) const
+        {
+            return this->index == other.index;
+        }
+
+        bool operator!=(const Iterator& other) const
+        {
+            return this->index != other.index;
+        }
+    private:
+        const std::vector<State>* table;
+        const uint64_t* words;
+        size_t index;
+
+        void skip()
+        {
+            while (this->index < this->table->size() && !Bitset::test(this->words, this->index))
+            {
+                this->index++;
+            }
+        }
+    };
+
+    /**
+     * @brief Create a view of a domain.
+     * @param table The state table of the topology.
+     * @param words The bitset of the state indices.
+     */
+    StateView(const std::vector<State>& table, const uint64_t* words) : table(&table), words(words)
+    {
+    }
+
+    /**
+     * @brief Get the bitset of the state indices.
+     * @return Pointer to the first word, the bitset has Bitset::getWords(table.size()) words.
+     */
+    const uint64_t* getWords() const
+    {
+        return this->words;
+    }
+
+    /**
+     * @brief Get the number of states.
+     * @return The number of states.
+     */
+    size_t size() const
+    {
+        return Bitset::count(this->words, Bitset::getWords(this->table->size()));
+    }
+
+    /**
+     * @brief Check if there are no states.
+     * @return True if there are no states, false otherwise.
+     */
+    bool empty() const
+    {
+        return this->begin() == this->end();
+    }
+
+    /**
+     * @brief Check if the view contains a state.
+     * @param state The state.
+     * @return True if the state is contained, false otherwise.
+     */
+    bool contains(const State& state) const
+    {
+        for (size_t i = 0; i < this->table->size(); i++)
+        {
+            if ((*this->table)[i] == state && Bitset::test(this->words, i))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Get the n-th state of the view.
+     * @param n The position of the state.
+     * @return The state.
+     */
+    const State& operator[](size_t n) const
+    {
+        auto it = this->begin();
+        std::advance(it, n);
+        return *it;
+    }
+
+    /**
+     * @brief Get the n-th state of the view.
+     * @param n The position of the state.
+     * @return The state.
+     * @throw std::out_of_range If the position is out of range.
+     */
+    const State& at(size_t n) const
+    {
+        if (n >= this->size())
+        {
+            throw std::out_of_range("State position out of range");
+        }
+
+        return (*this)[n];
+    }
+
+    Iterator begin() const
+    {
+        return Iterator(this->table, this->words, 0);
+    }
+
+    Iterator end() const
+    {
+        return Iterator(this->table, this->words, this->table->size());
+    }
+
+    /**
+     * @brief Copy the states into a vector.
+     * @return The states.
+     */
+    operator std::vector<State>() const
+    {
+        return std::vector<State>(this->begin(), this->end());
+    }
+private:
+    const std::vector<State>* table;
+    const uint64_t* words;
+};
+
+}
@@ -0,0 +1,399 @@
+/**
+ * @file StaticGrid.h
+ * @brief StaticGrid class for grids with a tileset known at compile time.
+ */
+
+#pragma once
+
+#include "Bitset.h"
+#include "Random.h"
+#include "IndexedHeap.h"
+#include "CartesianGraph.h"
+
+#include <array>
+#include <time.h>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+namespace WFC
+{
+
+/**
+ * @brief StaticGrid class for grids with a tileset known at compile time.
+ *
+ * The states and tokens of the tileset are compile-time constants, so the compatibility of the states is a constexpr table
+ * of masks (one bit per state) and the propagation works on single words without calling a compatible function.
+ * Two adjacent states are compatible if they have the same token in the direction of each other, like CartesianTopology::createCartTokens.
+ *
+ * The tileset is a type with the following static members:
+ * @code
+ * struct Tileset
+ * {
+ *     using State = char;
+ *     static constexpr size_t dimensions = 2;
+ *     static constexpr std::array<State, 2> states = { ' ', '-' };
+ *     static constexpr std::array<std::array<bool, 4>, 2> tokens = { { { 0, 0, 0, 0 }, { 1, 1, 0, 0 } } };
+ * };
+ * @endcode
+ *
+ * @tparam Tileset The tileset with at most 64 states.
+ */
+template <class Tileset>
+class StaticGrid
+{
+public:
+    using State = typename Tileset::State;
+
+    /**
+     * @brief The number of dimensions.
+     */
+    static constexpr size_t Dim = Tileset::dimensions;
+
+    /**
+     * @brief The number of states.
+     */
+    static constexpr size_t count = Tileset::states.size();
+
+    static_assert(count > 0 && count <= 64, "A static tileset has between 1 and 64 states");
+
+    /**
+     * @brief The smallest unsigned type with a bit for every state.
+     */
+    using Mask = std::conditional_t<count <= 16, uint16_t, std::conditional_t<count <= 32, uint32_t, uint64_t>>;
+
+    /**
+     * @brief States compatible with each state in each direction: rules[direction][state].
+     */
+    static constexpr std::array<std::array<Mask, count>, Dim * 2> rules = StaticGrid::getRules();
+
+    /**
+     * @brief The graph contains the adjacent nodes of every node.
+     */
+    std::shared_ptr<const CartesianGraph<Dim>> graph = std::make_shared<CartesianGraph<Dim>>();
+
+    /**
+     * @brief Weights of the states, in the order of the states of the tileset.
+     */
+    std::array<float, count> weights = StaticGrid::getWeights();
+
+    StaticGrid() = default;
+
+    /**
+     * @brief Create a grid where all nodes can have all states of the tileset.
+     * @param size The size of the grid.
+     * @param periods Whether the grid is periodic (true) or not (false) in each dimension.
+     */
+    StaticGrid(const std::array<size_t, Dim>& size, const std::array<bool, Dim>& periods = {});
+
+    /**
+     * @brief Collapse the grid using the Wave Function Collapse algorithm.
+     * @param seed The seed for the random number generator (Random::SplitMix64).
+     * @throw std::runtime_error If no valid states are found.
+     */
+    void collapse(unsigned int seed = time(NULL));
+
+    /**
+     * @brief Collapse the grid using the Wave Function Collapse algorithm with a specific random number generator.
+     * @tparam Engine The type of the generator, which generates 32 or 64 random bits.
+     * @param randGen The random number generator.
+     * @throw std::runtime_error If no valid states are found.
+     */
+    template <class Engine, class = typename Engine::result_type>
+    void collapse(Engine& randGen);
+
+    /**
+     * @brief Collapse a node with a specific state.
+     * @param node The index of the node to collapse.
+     * @param state The state to collapse the node with.
+     * @throw std::logic_error If the state is not valid.
+     * @throw std::runtime_error If no valid states are found.
+     */
+    void collapseNode(size_t node, const State& state);
+
+    /**
+     * @brief Get the number of nodes.
+     * @return The number of nodes.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the remaining states of a node.
+     * @param node The index of the node.
+     * @return The mask of the indices of the states in the tileset.
+     */
+    Mask getMask(size_t node) const;
+
+    /**
+     * @brief Get the first remaining state of a node.
+     * @param node The index of the node.
+     * @return The state, the only state once the node is collapsed.
+     */
+    const State& getState(size_t node) const;
+
+    /**
+     * @brief Check if the grid is correct.
+     *
+     * A grid is correct if all nodes have only one state and all adjacent nodes are compatible.
+     *
+     * @return True if the grid is correct, false otherwise.
+     */
+    bool isCorrect() const;
+private:
+    // Remaining states of each node
+    std::vector<Mask> domains;
+
+    // Random values breaking ties between nodes with the same number of states
+    std::vector<double> noise;
+
+    // Nodes with more than one state ordered by the number of states
+    IndexedHeap heap;
+
+    // Changed nodes whose adjacent nodes have to be reduced, a node is in the stack if it is queued
+    std::vector<uint32_t> stack;
+    std::vector<uint8_t> queued;
+
+    static constexpr std::array<std::array<Mask, count>, Dim * 2> getRules();
+    static constexpr std::array<float, count> getWeights();
+    void setDomain(size_t node, Mask domain);
+    bool propagate(size_t node);
+};
+
+template <class Tileset>
+StaticGrid<Tileset>::StaticGrid(const std::array<size_t, Dim>& size, const std::array<bool, Dim>& periods) :
+    graph(std::make_shared<const CartesianGraph<Dim>>(size, periods)),
+    domains(this->graph->size(), Mask(~uint64_t(0) >> (64 - count))),
+    noise(this->graph->size(), 0),
+    queued(this->graph->size(), 0)
+{
+    this->heap.assign(this->size());
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        this->setDomain(i, this->domains[i]);
+    }
+}
+
+template <class Tileset>
+void StaticGrid<Tileset>::collapse(unsigned int seed)
+{
+    Random::SplitMix64 randGen(seed);
+    this->collapse(randGen);
+}
+
+template <class Tileset>
+template <class Engine, class>
+void StaticGrid<Tileset>::collapse(Engine& randGen)
+{
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        this->noise[i] = Random::canonical(randGen);
+        this->setDomain(i, this->domains[i]);
+    }
+
+    while (!this->heap.empty())
+    {
+        size_t node = this->heap.top();
+
+        // Select a state of the node by its weight
+        double sum = 0;
+        for (uint64_t word = this->domains[node]; word != 0; word &= word - 1)
+        {
+            sum += this->weights[Bitset::lowest(word)];
+        }
+
+        size_t state = count;
+        double r = Random::canonical(randGen) * sum;
+        for (uint64_t word = this->domains[node]; word != 0; word &= word - 1)
+        {
+            size_t s = Bitset::lowest(word);
+            if (this->weights[s] > 0)
+            {
+                state = s;
+                if ((r -= this->weights[s]) < 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        if (state == count)
+        {
+            throw std::runtime_error("No valid states");
+        }
+
+        this->setDomain(node, Mask(uint64_t(1) << state));
+        if (!this->propagate(node))
+        {
+            throw std::runtime_error("No valid states");
+        }
+    }
+}
+
+template <class Tileset>
+void StaticGrid<Tileset>::collapseNode(size_t node, const State& state)
+{
+    size_t s = 0;
+    while (s < count && !(Tileset::states[s] == state))
+    {
+        s++;
+    }
+
+    if (s == count || !(this->domains[node] >> s & 1))
+    {
+        throw std::logic_error("Invalid state to collapse");
+    }
+
+    this->setDomain(node, Mask(uint64_t(1) << s));
+    if (!this->propagate(node))
+    {
+        throw std::runtime_error("No valid states");
+    }
+}
+
+template <class Tileset>
+size_t StaticGrid<Tileset>::size() const
+{
+    return this->graph->size();
+}
+
+template <class Tileset>
+typename StaticGrid<Tileset>::Mask StaticGrid<Tileset>::getMask(size_t node) const
+{
+    return this->domains[node];
+}
+
+template <class Tileset>
+const typename StaticGrid<Tileset>::State& StaticGrid<Tileset>::getState(size_t node) const
+{
+    return Tileset::states[Bitset::lowest(this->domains[node])];
+}
+
+template <class Tileset>
+bool StaticGrid<Tileset>::isCorrect() const
+{
+    for (size_t a = 0; a < this->size(); a++)
+    {
+        if (Bitset::popcount(this->domains[a]) != 1)
+        {
+            return false;
+        }
+
+        for (size_t d = 0; d < Dim * 2; d++)
+        {
+            uint32_t b = this->graph->getAdjacent(a, d);
+            if (b != CartesianGraph<Dim>::none && (StaticGrid::rules[d][Bitset::lowest(this->domains[a])] & this->domains[b]) != this->domains[b])
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+template <class Tileset>
+constexpr std::array<std::array<typename StaticGrid<Tileset>::Mask, StaticGrid<Tileset>::count>, StaticGrid<Tileset>::Dim * 2> StaticGrid<Tileset>::getRules()
+{
+    std::array<std::array<Mask, count>, Dim * 2> result = {};
+    for (size_t d = 0; d < Dim * 2; d++)
+    {
+        for (size_t a = 0; a < count; a++)
+        {
+            for (size_t b = 0; b < count; b++)
+            {
+                if (Tileset::tokens[a][d] == Tileset::tokens[b][d ^ 1])
+                {
+                    result[d][a] |= Mask(uint64_t(1) << b);
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+template <class Tileset>
+constexpr std::array<float, StaticGrid<Tileset>::count> StaticGrid<Tileset>::getWeights()
+{
+    std::array<float, count> result = {};
+    for (size_t s = 0; s < count; s++)
+    {
+        result[s] = 1;
+    }
+
+    return result;
+}
+
+template <class Tileset>
+void StaticGrid<Tileset>::setDomain(size_t node, Mask domain)
+{
+    this->domains[node] = domain;
+    size_t states = Bitset::popcount(domain);
+    if (states > 1)
+    {
+        this->heap.update(node, states + this->noise[node]);
+    }
+    else
+    {
+        this->heap.remove(node);
+    }
+}
+
+template <class Tileset>
+bool StaticGrid<Tileset>::propagate(size_t node)
+{
+    bool valid = true;
+    this->stack.assign(1, node);
+    this->queued[node] = 1;
+    while (!this->stack.empty())
+    {
+        size_t a = this->stack.back();
+        this->stack.pop_back();
+        this->queued[a] = 0;
+        if (!valid)
+        {
+            continue;
+        }
+
+        for (size_t d = 0; d < Dim * 2; d++)
+        {
+            uint32_t b = this->graph->getAdjacent(a, d);
+            if (b == CartesianGraph<Dim>::none)
+            {
+                continue;
+            }
+
+            // Union of the states of b compatible with any state of a
+            Mask allowed = 0;
+            for (uint64_t word = this->domains[a]; word != 0; word &= word - 1)
+            {
+                allowed |= StaticGrid::rules[d][Bitset::lowest(word)];
+            }
+
+            Mask domain = this->domains[b] & allowed;
+            if (domain == this->domains[b])
+            {
+                continue;
+            }
+
+            if (domain == 0)
+            {
+                valid = false;
+                break;
+            }
+
+            this->setDomain(b, domain);
+            if (!this->queued[b])
+            {
+                this->queued[b] = 1;
+                this->stack.push_back(b);
+            }
+        }
+    }
+
+    return valid;
+}
+
+}
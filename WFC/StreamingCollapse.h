@@ -0,0 +1,103 @@
+/**
+ * @file StreamingCollapse.h
+ * @brief Collapsing endless grids along the first axis with a sliding window.
+ */
+
+#pragma once
+
+#include "CartesianTopology.h"
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+namespace WFC::CartesianTopology
+{
+
+/**
+ * @brief Collapse an endless grid along the first axis with a sliding window.
+ *
+ * The window is a grid whose first axis is the width of the window. Each step collapses a copy of the window,
+ * with its first column fixed to the last emitted column, and emits the columns in order except the last margin columns,
+ * which are collapsed to keep the emitted columns continuable but discarded. Only the window is kept in memory.
+ * Each step draws from the stream of the seed with the index of the step (Random::SplitMix64).
+ *
+ * A column contains the states of the nodes with the same coordinate on the first axis, ordered by the index of the node in the window.
+ * The compatible functions receive the indices of the nodes in the window.
+ *
+ * @tparam Dim The number of dimensions.
+ * @tparam State The type of the states.
+ * @tparam Observer The type of the observer of the collapse.
+ * @param window The grid of the window, not periodic on the first axis.
+ * @param emit The function called with every finished column, the collapse stops when it returns false.
+ * @param seed The seed for the random number generator.
+ * @param margin The number of columns at the end of the window that are discarded.
+ * @param attempts The number of streams tried for each step.
+ * @throw std::logic_error If the window is periodic on the first axis or narrower than the margin and two columns.
+ * @throw std::runtime_error If no valid states are found for a step.
+ */
+template <size_t Dim, class State, class Observer>
+void collapseStream(
+    const CartesianGrid<Dim, State, Observer>& window,
+    const std::function<bool(const std::vector<State>& column)>& emit,
+    unsigned int seed = time(NULL),
+    size_t margin = 2,
+    size_t attempts = 8)
+{
+    size_t width = window.graph->getSize()[0];
+    if (window.graph->getPeriods()[0] || width < margin + 2)
+    {
+        throw std::logic_error("Invalid window size");
+    }
+
+    size_t height = window.size() / width;
+    std::vector<State> column;
+    column.reserve(height);
+    std::vector<std::pair<size_t, State>> assignments;
+    assignments.reserve(height);
+    CartesianGrid<Dim, State, Observer> topology;
+    for (size_t step = 0; ; step++)
+    {
+        assignments.clear();
+        for (size_t j = 0; j < column.size(); j++)
+        {
+            assignments.emplace_back(j * width, column[j]);
+        }
+
+        for (size_t attempt = 0; ; attempt++)
+        {
+            // The first column continues the last emitted column, its nodes are propagated by one wave
+            topology = window;
+            bool valid = std::all_of(assignments.begin(), assignments.end(), [&topology](const auto& assignment) { return topology.getStates(assignment.first).contains(assignment.second); });
+            valid = valid && topology.tryCollapseNodes(assignments);
+
+            Random::SplitMix64 randGen(seed, step * attempts + attempt);
+            if (valid && topology.tryCollapse(randGen))
+            {
+                break;
+            }
+
+            if (attempt + 1 >= attempts)
+            {
+                throw std::runtime_error("No valid states");
+            }
+        }
+
+        for (size_t x = step == 0 ? 0 : 1; x < width - margin; x++)
+        {
+            column.clear();
+            for (size_t j = 0; j < height; j++)
+            {
+                column.push_back(topology.getStates(x + j * width)[0]);
+            }
+
+            if (!emit(column))
+            {
+                return;
+            }
+        }
+    }
+}
+
+}
@@ -1,250 +1,3356 @@
 /**
  * @file Topology.h
  * @brief Topology class for the Wave Function Collapse algorithm.
- * 
+ *
  * The topology is a container for nodes and weights.
  */
 
 #pragma once
 
-#include "Node.h"
+#include "Graph.h"
+#include "Binary.h"
+#include "Bitset.h"
+#include "Random.h"
+#include "StateView.h"
+#include "Kernels.h"
+#include "Workers.h"
+#include "Observer.h"
+#include "IndexedHeap.h"
 
 #include <map>
-#include <queue>
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <time.h>
-#include <random>
+#include <memory>
 #include <vector>
+#include <cstdint>
+#include <ostream>
+#include <optional>
+#include <algorithm>
+#include <exception>
 #include <stdexcept>
 #include <functional>
+#include <type_traits>
+#include <memory_resource>
 
 namespace WFC
 {
 
+/**
+ * @brief Heuristic used to select the next node to collapse.
+ */
+enum class Heuristic
+{
+    /**
+     * @brief Select the node with the fewest remaining states.
+     *
+     * The result of a seed is the same on every platform.
+     */
+    Count,
+
+    /**
+     * @brief Select the node with the lowest Shannon entropy of the weights of its remaining states.
+     *
+     * The entropy uses std::log, whose rounding depends on the math library, so the order of nodes with almost the same entropy
+     * and the result of a seed are only reproducible on the same platform.
+     */
+    Entropy,
+};
+
+/**
+ * @brief Status of a collapse that does not throw.
+ */
+enum class Status
+{
+    /**
+     * @brief All nodes have one state.
+     */
+    Success,
+
+    /**
+     * @brief A node has no valid states left and no decision can be undone.
+     *
+     * A collapse leaves the nodes as they were at the contradiction, reset() restores them.
+     * A change of nodes, such as tryCollapseNode or tryRestrictNodes, is undone and leaves the nodes unchanged.
+     */
+    Contradiction,
+
+    /**
+     * @brief The backtracks are exhausted.
+     */
+    Exhausted,
+
+    /**
+     * @brief The collapse was cancelled by another collapse of a portfolio.
+     */
+    Cancelled,
+};
+
+/**
+ * @brief Result of a collapse that does not throw.
+ */
+struct Result
+{
+    /**
+     * @brief Index of a missing node.
+     */
+    static constexpr size_t none = SIZE_MAX;
+
+    /**
+     * @brief The status of the collapse.
+     */
+    Status status = Status::Success;
+
+    /**
+     * @brief The node without valid states of the last contradiction, or Result::none.
+     */
+    size_t node = Result::none;
+
+    /**
+     * @brief Check if the collapse succeeded.
+     * @return True if the status is Status::Success, false otherwise.
+     */
+    explicit operator bool() const
+    {
+        return this->status == Status::Success;
+    }
+};
+
+/**
+ * @brief Propagation used by a compiled topology.
+ */
+enum class Propagation
+{
+    /**
+     * @brief Count the supports of every state in every direction, so a removal only visits the affected states (AC-4).
+     */
+    Supports,
+
+    /**
+     * @brief Intersect the domain of a node with the union of the compatible states of an adjacent node with vectorized kernels (AC-3).
+     *
+     * Uses no memory per node and state, which makes it suited for large state counts.
+     */
+    Masks,
+};
+
 /**
  * @brief Topology class for the Wave Function Collapse algorithm.
- * 
+ *
  * The topology is a container for nodes and weights.
- * 
+ * Nodes are identified by their index in the graph.
+ * The remaining states of each node (its domain) are stored as a bitset of indices into the state table.
+ * A copy of a topology is a cheap snapshot: the graph and the compiled tables are shared, only the flat domain storage is copied,
+ * so a topology can be built and constrained once and copied for every collapse.
+ * The storage of the nodes and the scratch buffers of the collapse are allocated from a memory resource, once per topology,
+ * and reused by every collapse. Copies allocate from the default memory resource, assignments keep the memory resource of the target.
+ *
  * @tparam State The type of the states.
+ * @tparam GraphType The type of the graph, Graph or a graph with the same interface such as CartesianGraph.
+ * @tparam Observer The type of the observer of the collapse, NoObserver or an observer with the same interface such as Stats.
  */
-template <class State>
+template <class State, class GraphType = Graph, class Observer = NoObserver>
 class Topology
 {
-public:
-    /**
-     * @brief Nodes are elements of the topology.
-     */
-    std::vector<Node<State>> nodes;
+public:
+    /**
+     * @brief The graph contains the adjacent nodes of every node.
+     *
+     * The graph is immutable and shared between copies of the topology.
+     */
+    std::shared_ptr<const GraphType> graph = std::make_shared<GraphType>();
+
+    /**
+     * @brief The state table contains all states the nodes can have.
+     */
+    std::vector<State> states;
+
+    /**
+     * @brief Weights are used to bias the selection of states.
+     */
+    std::map<State, float> weights;
+
+    /**
+     * @brief The compatible function is used to check if two states are compatible.
+     *
+     * This function has to be defined by the user and should be symmetric ( compatible(a, b) == compatible(b, a) ).
+     * @param a The index of the first node.
+     * @param aState The state of the first node.
+     * @param direction The direction of the second node from the first node.
+     * @param b The index of the second node.
+     * @param bState The state of the second node.
+     * @return True if the states are compatible, false otherwise.
+     */
+    std::function<bool(size_t, const State&, size_t, size_t, const State&)> compatible;
+
+    /**
+     * @brief The direction-aware compatible function is used to check if two states are compatible in a direction.
+     *
+     * If defined, it is used instead of the compatible function. It only receives the direction and the indices of the states
+     * in the state table, so it can be answered from a precomputed lookup table.
+     * @param aState The index of the state of the first node.
+     * @param direction The direction of the second node from the first node.
+     * @param bState The index of the state of the second node.
+     * @return True if the states are compatible, false otherwise.
+     */
+    std::function<bool(size_t aState, size_t direction, size_t bState)> compatibleStates;
+
+    /**
+     * @brief The heuristic used to select the next node to collapse.
+     */
+    Heuristic heuristic = Heuristic::Count;
+
+    /**
+     * @brief The propagation used after compile(), has to be set before compile().
+     */
+    Propagation propagation = Propagation::Supports;
+
+    /**
+     * @brief The maximum number of times a collapse undoes a decision after a contradiction.
+     *
+     * Removed states are recorded on a trail, so a contradiction rolls the topology back to the last decision
+     * and the decided state is removed from the node instead. If zero, the first contradiction ends the collapse.
+     */
+    size_t backtracks = 0;
+
+    /**
+     * @brief The observer receives the events of the collapse, the propagation and the compilation.
+     *
+     * It is mutable, so the compatible function can be counted in const member functions,
+     * and takes no space if it is empty, like NoObserver.
+     */
+    [[no_unique_address]] mutable Observer observer;
+
+    Topology() = default;
+
+    /**
+     * @brief Create a topology with a specific graph.
+     *
+     * All nodes can have all states of the state table.
+     *
+     * @param states The state table.
+     * @param graph The graph of the nodes.
+     * @param resource The memory resource of the storage of the nodes, for example a std::pmr::monotonic_buffer_resource.
+     */
+    Topology(const std::vector<State>& states, GraphType graph, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+     * @brief Collapse the topology using the Wave Function Collapse algorithm.
+     * @param seed The seed for the random number generator (Random::SplitMix64).
+     * @throw std::runtime_error If no valid states are found or the backtracks are exhausted.
+     */
+    void collapse(unsigned int seed = time(NULL));
+
+    /**
+     * @brief Collapse the topology using the Wave Function Collapse algorithm with a specific random number generator.
+     *
+     * The result only depends on the values of the generator, see Random::canonical.
+     *
+     * @tparam Engine The type of the generator, which generates 32 or 64 random bits.
+     * @param randGen The random number generator.
+     * @throw std::runtime_error If no valid states are found or the backtracks are exhausted.
+     */
+    template <class Engine, class = typename Engine::result_type>
+    void collapse(Engine& randGen);
+
+    /**
+     * @brief Collapse the topology without throwing when no valid states are found.
+     *
+     * A contradiction stops the collapse and leaves the topology partially collapsed, the result locates the contradiction.
+     *
+     * @param seed The seed for the random number generator (Random::SplitMix64).
+     * @return The result of the collapse.
+     */
+    Result tryCollapse(unsigned int seed = time(NULL));
+
+    /**
+     * @brief Collapse the topology with a specific random number generator without throwing when no valid states are found.
+     * @tparam Engine The type of the generator, which generates 32 or 64 random bits.
+     * @param randGen The random number generator.
+     * @return The result of the collapse.
+     */
+    template <class Engine, class = typename Engine::result_type>
+    Result tryCollapse(Engine& randGen);
+
+    /**
+     * @brief Collapse copies of the topology with different seeds concurrently and keep the first valid result.
+     *
+     * Every thread collapses a copy of the topology with the next seed until a collapse succeeds,
+     * the other collapses are cancelled and the topology is replaced by the result.
+     * The compatible functions have to be safe to call from multiple threads.
+     * The observer of each copy continues the observer of the topology, so the observer keeps
+     * its previous events and adds the events of the result, the events of the other copies are discarded.
+     *
+     * @param seeds The seeds to try.
+     * @param threads The number of threads.
+     * @return The seed of the result.
+     * @throw std::runtime_error If the collapse fails for all seeds.
+     */
+    unsigned int collapsePortfolio(const std::vector<unsigned int>& seeds, size_t threads = std::thread::hardware_concurrency());
+
+    /**
+     * @brief Collapse the topology by deciding several distant nodes per step and propagating their waves on multiple threads.
+     *
+     * Each step decides up to batch nodes among the 4 * batch nodes with the lowest entropy, skipping the nodes within
+     * 2 * distance + 1 steps of a node decided before in the step. The wave of each decision is propagated on a worker thread
+     * inside the region of the nodes within distance steps of its node, which no other wave reads or writes.
+     * The waves are then merged in the order of their decisions on the calling thread, which continues each wave past its region.
+     * A wave that reaches the region of a wave merged after it collides: it is undone and propagated again alone,
+     * the later waves are undone and decided again in the next steps. Contradictions are handled like collapse().
+     * The result only depends on the seed, not on the number of threads. The topology has to be symmetric
+     * and the compatible functions have to be safe to call from multiple threads.
+     * The selection and the merge run on the calling thread, so it is only faster than collapse() when the waves are expensive,
+     * for example with many states or an expensive compatible function. Tilesets with small waves collapse faster with collapse().
+     *
+     * @param batch The maximum number of nodes decided per step.
+     * @param distance The number of steps the region of a wave extends around its node.
+     * @param seed The seed for the random number generator (Random::SplitMix64).
+     * @param threads The number of threads.
+     * @throw std::runtime_error If no valid states are found or the backtracks are exhausted.
+     */
+    void collapseBatched(size_t batch, size_t distance, unsigned int seed = time(NULL), size_t threads = std::thread::hardware_concurrency());
+
+    /**
+     * @brief Collapse the topology by deciding several distant nodes per step without throwing when no valid states are found.
+     * @param batch The maximum number of nodes decided per step.
+     * @param distance The number of steps the region of a wave extends around its node.
+     * @param seed The seed for the random number generator (Random::SplitMix64).
+     * @param threads The number of threads.
+     * @return The result of the collapse.
+     */
+    Result tryCollapseBatched(size_t batch, size_t distance, unsigned int seed = time(NULL), size_t threads = std::thread::hardware_concurrency());
+
+    /**
+     * @brief Collapse the topology by deciding several distant nodes per step with a specific random number generator without throwing.
+     * @tparam Engine The type of the generator, which generates 32 or 64 random bits.
+     * @param batch The maximum number of nodes decided per step.
+     * @param distance The number of steps the region of a wave extends around its node.
+     * @param randGen The random number generator.
+     * @param threads The number of threads.
+     * @return The result of the collapse.
+     */
+    template <class Engine, class = typename Engine::result_type>
+    Result tryCollapseBatched(size_t batch, size_t distance, Engine& randGen, size_t threads = std::thread::hardware_concurrency());
+
+    /**
+     * @brief Collapse a region of the topology again.
+     *
+     * The nodes and the nodes within a margin around them are reset to all states of the state table,
+     * the states that are not compatible with the nodes around the region are removed and only the region is collapsed.
+     * The cost depends on the size of the region instead of the size of the topology.
+     * If no valid states are found, the region and the nodes around it, the only nodes a repair of a collapsed topology changes,
+     * are restored to their states before the repair.
+     *
+     * @param nodes The indices of the nodes to reset.
+     * @param margin The number of steps the region extends around the nodes.
+     * @param seed The seed for the random number generator (Random::SplitMix64).
+     * @throw std::runtime_error If no valid states are found or the backtracks are exhausted.
+     */
+    void repair(const std::vector<size_t>& nodes, size_t margin = 1, unsigned int seed = time(NULL));
+
+    /**
+     * @brief Collapse a region of the topology again with a specific random number generator.
+     * @tparam Engine The type of the generator, which generates 32 or 64 random bits.
+     * @param nodes The indices of the nodes to reset.
+     * @param margin The number of steps the region extends around the nodes.
+     * @param randGen The random number generator.
+     * @throw std::runtime_error If no valid states are found or the backtracks are exhausted.
+     */
+    template <class Engine, class = typename Engine::result_type>
+    void repair(const std::vector<size_t>& nodes, size_t margin, Engine& randGen);
+
+    /**
+     * @brief Collapse a region of the topology again without throwing when no valid states are found.
+     * @param nodes The indices of the nodes to reset.
+     * @param margin The number of steps the region extends around the nodes.
+     * @param seed The seed for the random number generator (Random::SplitMix64).
+     * @return The result of the repair, a failed repair restores the nodes.
+     */
+    Result tryRepair(const std::vector<size_t>& nodes, size_t margin = 1, unsigned int seed = time(NULL));
+
+    /**
+     * @brief Collapse a region of the topology again with a specific random number generator without throwing.
+     * @tparam Engine The type of the generator, which generates 32 or 64 random bits.
+     * @param nodes The indices of the nodes to reset.
+     * @param margin The number of steps the region extends around the nodes.
+     * @param randGen The random number generator.
+     * @return The result of the repair, a failed repair restores the nodes.
+     */
+    template <class Engine, class = typename Engine::result_type>
+    Result tryRepair(const std::vector<size_t>& nodes, size_t margin, Engine& randGen);
+
+    /**
+     * @brief Collapse a node with a specific state.
+     * @param node The index of the node to collapse.
+     * @param state The state to collapse the node with.
+     * @throw std::logic_error If the state is not valid.
+     * @throw std::runtime_error If no valid states are found, the nodes are left unchanged.
+     */
+    void collapseNode(size_t node, const State& state);
+
+    /**
+     * @brief Collapse a node with a specific state without throwing when no valid states are found.
+     * @param node The index of the node to collapse.
+     * @param state The state to collapse the node with.
+     * @return The result of the propagation, a contradiction leaves the nodes unchanged.
+     * @throw std::logic_error If the state is not valid.
+     */
+    Result tryCollapseNode(size_t node, const State& state);
+
+    /**
+     * @brief Restrict a node to a subset of its states.
+     * @param node The index of the node to restrict.
+     * @param states The states the node can keep.
+     * @throw std::logic_error If none of the states is valid.
+     * @throw std::runtime_error If no valid states are found, the nodes are left unchanged.
+     */
+    void restrictNode(size_t node, const std::vector<State>& states);
+
+    /**
+     * @brief Restrict a node to a subset of its states without throwing when no valid states are found.
+     * @param node The index of the node to restrict.
+     * @param states The states the node can keep.
+     * @return The result of the propagation, a contradiction leaves the nodes unchanged.
+     * @throw std::logic_error If none of the states is valid.
+     */
+    Result tryRestrictNode(size_t node, const std::vector<State>& states);
+
+    /**
+     * @brief Collapse many nodes with specific states and propagate them together.
+     *
+     * The states of all nodes are removed first and propagated in a single wave, instead of one wave per node.
+     * If a state is not valid, the nodes are left unchanged.
+     *
+     * @param assignments The indices of the nodes with the states to collapse them with.
+     * @throw std::logic_error If a state is not valid.
+     * @throw std::runtime_error If no valid states are found, the nodes are left unchanged.
+     */
+    void collapseNodes(const std::vector<std::pair<size_t, State>>& assignments);
+
+    /**
+     * @brief Collapse many nodes with specific states without throwing when no valid states are found.
+     * @param assignments The indices of the nodes with the states to collapse them with.
+     * @return The result of the propagation, a contradiction leaves the nodes unchanged.
+     * @throw std::logic_error If a state is not valid.
+     */
+    Result tryCollapseNodes(const std::vector<std::pair<size_t, State>>& assignments);
+
+    /**
+     * @brief Restrict many nodes to subsets of their states and propagate them together.
+     *
+     * The states of all nodes are removed first and propagated in a single wave, instead of one wave per node.
+     * If none of the states of a node is valid, the nodes are left unchanged.
+     *
+     * @param restrictions The indices of the nodes with the states each node can keep.
+     * @throw std::logic_error If none of the states of a node is valid.
+     * @throw std::runtime_error If no valid states are found, the nodes are left unchanged.
+     */
+    void restrictNodes(const std::vector<std::pair<size_t, std::vector<State>>>& restrictions);
+
+    /**
+     * @brief Restrict many nodes to subsets of their states without throwing when no valid states are found.
+     * @param restrictions The indices of the nodes with the states each node can keep.
+     * @return The result of the propagation, a contradiction leaves the nodes unchanged.
+     * @throw std::logic_error If none of the states of a node is valid.
+     */
+    Result tryRestrictNodes(const std::vector<std::pair<size_t, std::vector<State>>>& restrictions);
+
+    /**
+     * @brief Restrict many nodes to the same subset of their states and propagate them together.
+     * @param nodes The indices of the nodes to restrict.
+     * @param states The states the nodes can keep.
+     * @throw std::logic_error If none of the states of a node is valid.
+     * @throw std::runtime_error If no valid states are found, the nodes are left unchanged.
+     */
+    void restrictNodes(const std::vector<size_t>& nodes, const std::vector<State>& states);
+
+    /**
+     * @brief Restrict many nodes to the same subset of their states without throwing when no valid states are found.
+     * @param nodes The indices of the nodes to restrict.
+     * @param states The states the nodes can keep.
+     * @return The result of the propagation, a contradiction leaves the nodes unchanged.
+     * @throw std::logic_error If none of the states of a node is valid.
+     */
+    Result tryRestrictNodes(const std::vector<size_t>& nodes, const std::vector<State>& states);
+
+    /**
+     * @brief Compile the compatible function into per-direction lookup tables.
+     *
+     * The compatible function is evaluated once for every pair of states in every direction (index of the adjacent node),
+     * afterwards the propagation uses the tables and support counters (or vectorized masks, see propagation) instead of calling the compatible function.
+     * The compatibility of two states must only depend on the direction and the topology must be symmetric
+     * (if b is adjacent to a, a is adjacent to b).
+     *
+     * @throw std::logic_error If the topology is not symmetric.
+     * @throw std::runtime_error If no valid states are found.
+     */
+    void compile();
+
+    /**
+     * @brief Compile with the tables of another compiled topology instead of evaluating the compatible function again.
+     *
+     * The lookup tables are shared, only the directions between adjacent nodes are paired again for the graph of this topology,
+     * for example for the windows of a grid, which have the same state table and directions as the grid.
+     *
+     * @param other The compiled topology.
+     * @throw std::logic_error If the other topology is not compiled or has another state table or number of directions, or the topology is not symmetric.
+     * @throw std::runtime_error If no valid states are found.
+     */
+    void compile(const Topology& other);
+
+    /**
+     * @brief Restore all states of every node in place, for example to reuse a topology from a pool for the next collapse.
+     *
+     * The graph, state table, weights, weight tables, masks and compiled tables are kept, the nodes are restricted to their masks again
+     * and the other restrictions and decisions are removed. A compiled topology removes the states without support again, like compile().
+     * No memory is allocated once the topology has collapsed.
+     *
+     * @throw std::runtime_error If no valid states are found.
+     */
+    void reset();
+
+    /**
+     * @brief Check if the compatible function is compiled.
+     * @return True if compile() was called, false otherwise.
+     */
+    bool isCompiled() const;
+
+    /**
+     * @brief Get the number of nodes.
+     * @return The number of nodes.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get the memory resource of the storage of the nodes.
+     * @return The memory resource.
+     */
+    std::pmr::memory_resource* getResource() const;
+
+    /**
+     * @brief Get the remaining states of a node.
+     * @param node The index of the node.
+     * @return The view of the states, invalidated when the topology is modified.
+     */
+    StateView<State> getStates(size_t node) const;
+
+    /**
+     * @brief Add a weight table that overrides the weights of the nodes it is set for, for example one per biome.
+     *
+     * States without a weight in the table have their weight from weights.
+     *
+     * @param weights The weights of the states.
+     * @return The index of the table, table 0 is the weights of all nodes.
+     */
+    size_t addWeightTable(const std::map<State, float>& weights);
+
+    /**
+     * @brief Set the weight table of a node.
+     * @param node The index of the node.
+     * @param table The index of the table returned by addWeightTable, or 0 for the weights.
+     * @throw std::out_of_range If the table does not exist.
+     */
+    void setWeightTable(size_t node, size_t table);
+
+    /**
+     * @brief Get the weights of a weight table.
+     * @param table The index of the table, 0 for the weights.
+     * @return The weights of the states, states without a weight have their weight from weights (or 1).
+     * @throw std::out_of_range If the table does not exist.
+     */
+    const std::map<State, float>& getWeights(size_t table) const;
+
+    /**
+     * @brief Get the weight table of a node.
+     * @param node The index of the node.
+     * @return The index of the table, 0 for the weights.
+     */
+    size_t getWeightTable(size_t node) const;
+
+    /**
+     * @brief Get the weights of a weight table as the collapse resolves them.
+     *
+     * Weights below zero are zero and states without a weight in the table have their weight from weights (or 1).
+     *
+     * @param table The index of the table, 0 for the weights.
+     * @param weights The weight w of every state, in the order of the state table.
+     * @param weightLogs The value w * log(w) of every state, in the order of the state table.
+     * @throw std::out_of_range If the table does not exist.
+     */
+    void getResolvedWeights(size_t table, double* weights, double* weightLogs) const;
+
+    /**
+     * @brief Get the compatible states for every pair of states in every direction, like compile().
+     *
+     * A compiled topology copies its tables. Otherwise the compatible function is evaluated on the first node
+     * that has an adjacent node in each direction, so the compatibility of two states must only depend on the direction.
+     *
+     * @return The bitsets of the states b compatible with each state a in each direction d: [d][a][word].
+     */
+    std::vector<uint64_t> getRules() const;
+
+    /**
+     * @brief Get the entropy of a node from the weights of its remaining states, like the Entropy heuristic.
+     * @param sum The sum of the weights w.
+     * @param sumLogs The sum of the values w * log(w).
+     * @param noise The random value in [0, 1) of the node that breaks ties.
+     * @return The entropy.
+     */
+    static double getEntropy(double sum, double sumLogs, double noise);
+
+    /**
+     * @brief Select a state of a domain with a probability proportional to its weight, like the collapse.
+     * @tparam Engine The type of the generator, which generates 32 or 64 random bits.
+     * @tparam Filter The type of the filter.
+     * @param domain The bitset of the states.
+     * @param words The number of words of the bitset.
+     * @param weights The weights of the states.
+     * @param randGen The random number generator.
+     * @param candidates The scratch buffer of the candidate states.
+     * @param cumulativeWeights The scratch buffer of the cumulative weights of the candidate states.
+     * @param filter The function that tells if a state with a positive weight is a candidate.
+     * @return The index of the state, or Result::none if there is no candidate.
+     */
+    template <class Engine, class Filter>
+    static size_t sampleState(
+        const uint64_t* domain,
+        size_t words,
+        const double* weights,
+        Engine& randGen,
+        std::pmr::vector<size_t>& candidates,
+        std::pmr::vector<double>& cumulativeWeights,
+        const Filter& filter);
+
+    /**
+     * @brief Add a mask of the states the nodes it is set for can have, for example one per region.
+     * @param states The allowed states, states that are not in the state table are ignored.
+     * @return The index of the mask, mask 0 allows all states.
+     * @throw std::logic_error If none of the states is valid.
+     */
+    size_t addMask(const std::vector<State>& states);
+
+    /**
+     * @brief Set the mask of a node.
+     *
+     * The mask is applied whenever the states of the node are restored, by reset() and repair().
+     * The remaining states are not changed, restrictNode applies the mask before the next collapse.
+     *
+     * @param node The index of the node.
+     * @param mask The index of the mask returned by addMask, or 0 for all states.
+     * @throw std::out_of_range If the mask does not exist.
+     */
+    void setMask(size_t node, size_t mask);
+
+    /**
+     * @brief Get the allowed states of a mask.
+     * @param mask The index of the mask, 0 for all states.
+     * @return The allowed states.
+     * @throw std::out_of_range If the mask does not exist.
+     */
+    std::vector<State> getMaskStates(size_t mask) const;
+
+    /**
+     * @brief Get the mask of a node.
+     * @param node The index of the node.
+     * @return The index of the mask, 0 for all states.
+     */
+    size_t getMask(size_t node) const;
+
+    /**
+     * @brief Check if the topology is correct.
+     *
+     * A topology is correct if all nodes have only one state and all adjacent nodes are compatible.
+     *
+     * @return True if the topology is correct, false otherwise.
+     */
+    bool isCorrect() const;
+
+    /**
+     * @brief Check if states are a correct collapse of the topology, for example a result assembled from several topologies.
+     *
+     * The states are correct if each state is one of the remaining states of its node and the states of all adjacent nodes are compatible.
+     *
+     * @param states The state of every node.
+     * @return True if the states are correct, false otherwise.
+     */
+    bool isCorrect(const std::vector<State>& states) const;
+
+    /**
+     * @brief Write the topology in a binary format.
+     *
+     * The format contains the state table, the weights, the masks, the graph, the domains, the compiled tables and the support counters,
+     * so a constrained topology can be prepared once and loaded by many processes. A collapsed topology is written in the same format,
+     * its domains contain the result. The compatible functions and the observer are not written.
+     *
+     * @param stream The output stream, opened in binary mode.
+     * @throw std::runtime_error If the stream fails.
+     */
+    void save(std::ostream& stream) const;
+
+    /**
+     * @brief Load a topology written by save().
+     *
+     * The compiled tables are used in place and keep the buffer alive, only the domains and the support counters are copied,
+     * so a file mapped with Binary::mapFile is shared by all processes that load it.
+     * A topology saved before compile() needs its compatible function again before it is collapsed.
+     *
+     * @param buffer The binary data, for example from Binary::mapFile or Binary::readFile.
+     * @param resource The memory resource of the storage of the nodes.
+     * @return The topology.
+     * @throw std::runtime_error If the data is not a valid topology with the same state type and graph type.
+     */
+    static Topology load(const Binary::Buffer& buffer, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+private:
+    struct Compiled
+    {
+        // Bitset of states b compatible with state a in direction d: [d][a][word]
+        const uint64_t* rules = nullptr;
+
+        // Bitset of states a compatible with state b in direction d: [d][b][word]
+        const uint64_t* transposed = nullptr;
+
+        // Direction from the adjacent node back to the node: [slot]
+        const uint32_t* opposite = nullptr;
+
+        // Number of directions of the tables
+        size_t directions = 0;
+
+        // Storage of the tables filled by compile(), or the loaded data the tables point into
+        std::vector<uint64_t> ownedRules;
+        std::vector<uint64_t> ownedTransposed;
+        std::vector<uint32_t> ownedOpposite;
+        std::shared_ptr<const void> data;
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t stateSize;
+        uint64_t states;
+        uint64_t nodes;
+        uint64_t directions;
+        uint64_t backtracks;
+        uint8_t compiled;
+        uint8_t counting;
+        uint8_t propagation;
+        uint8_t heuristic;
+        uint32_t weightTables;
+        uint32_t masks;
+    };
+
+    struct Decision
+    {
+        size_t trail;
+        size_t node;
+        size_t state;
+    };
+
+    struct Wave
+    {
+        // Decided node and state
+        size_t node = 0;
+        size_t state = 0;
+
+        // Removed (node, state) pairs, the first processed ones are subtracted from the support counters
+        std::vector<std::pair<size_t, size_t>> removals;
+        size_t processed = 0;
+
+        // Changed nodes to reduce the adjacent nodes of, and the changed nodes with adjacent nodes outside the region
+        std::vector<size_t> worklist;
+        std::vector<size_t> boundary;
+
+        // States outside the region that lost their last support, removed when the wave is merged
+        std::vector<std::pair<size_t, size_t>> pending;
+
+        // Reduced nodes and evaluations of the compatible function, passed to the observer when the wave is merged
+        std::vector<size_t> reduced;
+        size_t compatibleCalls = 0;
+
+        // Scratch bitsets of the allowed and removed states
+        std::vector<uint64_t> allowed;
+        std::vector<uint64_t> removed;
+
+        // Node without valid states, or Result::none
+        size_t conflict = Result::none;
+    };
+
+    // Number of words of each domain
+    size_t words = 0;
+
+    // Remaining states of each node: [node][word]
+    std::pmr::vector<uint64_t> domains;
+
+    // Number of remaining states of each node
+    std::pmr::vector<size_t> sizes;
+
+    // Random values breaking ties between nodes with the same entropy
+    std::pmr::vector<double> noise;
+
+    // Weight tables after the weights, and the table of each node (empty if all nodes use the weights)
+    std::vector<std::map<State, float>> weightTables;
+    std::pmr::vector<uint32_t> weightIndices;
+
+    // Allowed states of the masks after mask 0, and the mask of each node (empty if all nodes allow all states): [mask - 1][word]
+    std::pmr::vector<uint64_t> masks;
+    std::pmr::vector<uint32_t> maskIndices;
+
+    // Weight w and w * log(w) of each state, resolved from the weight tables at the start of a collapse: [table][state]
+    std::pmr::vector<double> stateWeights;
+    std::pmr::vector<double> stateWeightLogs;
+
+    // Sums of w and w * log(w) over the remaining states of each node
+    std::pmr::vector<double> sumWeights;
+    std::pmr::vector<double> sumWeightLogs;
+
+    // Nodes with more than one state ordered by entropy
+    IndexedHeap heap;
+
+    // Ring buffer of changed nodes whose adjacent nodes have to be reduced
+    std::pmr::vector<size_t> worklist;
+
+    // A node is in the worklist if its mark is equal to the current epoch
+    std::pmr::vector<uint32_t> marks;
+    uint32_t epoch = 0;
+
+    // Removed (node, state) pairs in the order of removal, the compiled propagation uses it as its queue
+    std::pmr::vector<std::pair<size_t, size_t>> trail;
+
+    // Number of trail entries already subtracted from the support counters
+    size_t propagated = 0;
+
+    // Decisions of a backtracking collapse with the size of the trail before each decision
+    std::pmr::vector<Decision> decisions;
+
+    // Tables of the compiled compatible function, immutable and shared between copies of the topology
+    std::shared_ptr<const Compiled> compiled;
+
+    // Number of states of the adjacent node compatible with each state: [slot][state], empty without support counters
+    std::pmr::vector<uint32_t> supports;
+
+    // Node without valid states of the last contradiction
+    size_t conflict = Result::none;
+
+    // Scratch bitsets of the allowed and removed states of the mask propagation and of restrictNode
+    std::pmr::vector<uint64_t> allowed;
+    std::pmr::vector<uint64_t> removed;
+
+    // Scratch buffers of the candidate states of getState with their cumulative weights, and of the region of repair (or the changed nodes of a batch)
+    std::pmr::vector<size_t> candidates;
+    std::pmr::vector<double> cumulativeWeights;
+    std::pmr::vector<size_t> region;
+
+    // Scratch buffers of collapseBatched: the wave that owns each node and the last visit of each node by the selection
+    std::pmr::vector<uint32_t> owners;
+    std::pmr::vector<uint32_t> visits;
+
+    // Scratch buffer of repair: the domains of the region and of the nodes around it before the repair
+    std::pmr::vector<uint64_t> saved;
+
+    static void check(const Result& result);
+    template <class Engine>
+    Result collapse(Engine& randGen, const std::atomic<bool>* cancelled);
+    template <class Engine>
+    void initialize(Engine& randGen);
+    void resolveWeights();
+    size_t getWeightRow(size_t node) const;
+    size_t fillDomain(size_t node);
+    void sumNode(size_t node);
+    void nextEpoch();
+    void countSupports(const size_t* nodes, size_t count);
+    void restoreDomains(const size_t* nodes, size_t count, const uint64_t* domains);
+    template <class Engine>
+    Result search(Engine& randGen, const std::atomic<bool>* cancelled);
+    Result backtrack(size_t& backtracked);
+    template <class Engine>
+    Result searchBatched(size_t batch, size_t distance, Engine& randGen, size_t threads);
+    void propagateWave(Wave& wave, const std::pmr::vector<uint32_t>& owners, uint32_t owner);
+    bool eraseInWave(Wave& wave, size_t node, size_t state);
+    void restoreWave(const Wave& wave);
+    void removeState(size_t node, size_t state);
+    void restoreState(size_t node, size_t state, bool supported);
+    uint64_t* getDomain(size_t node);
+    const uint64_t* getDomain(size_t node) const;
+    size_t getStateIndex(const State& state) const;
+    bool isCollapsed() const;
+    size_t getMinEntropy() const;
+    void setSize(size_t node, size_t size);
+    double getEntropy(size_t node) const;
+    bool erase(size_t node, size_t state);
+    bool ban(size_t node, size_t state);
+    void undo(size_t trail);
+    bool assign(size_t node, size_t state);
+    size_t getRemoved(size_t node, const State* states, size_t count);
+    Result propagateBatch();
+    Result endChange(bool valid);
+    std::vector<uint64_t> evaluateRules() const;
+    void compileTables(const std::shared_ptr<const Compiled>& source);
+    void prune();
+    bool propagate(size_t node);
+    bool propagate(const size_t* nodes, size_t count);
+    bool propagateWorklist(const size_t* nodes, size_t size, size_t& visited);
+    bool reduceStates(size_t a, bool& changed);
+    bool reduceMasks(size_t a, size_t direction, size_t b, bool& changed);
+    Kernels::Intersection intersectMasks(size_t a, size_t direction, size_t b, uint64_t* allowed, uint64_t* removed) const;
+    bool isCounting() const;
+    template <class Engine>
+    size_t getState(size_t node, Engine& randGen);
+    bool isPlaceable(size_t node, size_t state, size_t* calls = nullptr) const;
+    bool isCompatible(size_t a, size_t aState, size_t direction, size_t b, size_t bState, size_t* calls = nullptr) const;
+    bool isPairCorrect(size_t a, size_t aState, size_t direction, size_t b, size_t bState) const;
+    bool propagateCompiled();
+    void updateSupports(size_t b, size_t bState, int delta);
+};
+
+template <class State, class GraphType, class Observer>
+Topology<State, GraphType, Observer>::Topology(const std::vector<State>& states, GraphType graph, std::pmr::memory_resource* resource) :
+    graph(std::make_shared<const GraphType>(std::move(graph))),
+    states(states),
+    words(Bitset::getWords(states.size())),
+    domains(this->graph->size() * Bitset::getWords(states.size()), resource),
+    sizes(this->graph->size(), states.size(), resource),
+    noise(this->graph->size(), 0, resource),
+    weightIndices(resource),
+    masks(resource),
+    maskIndices(resource),
+    stateWeights(resource),
+    stateWeightLogs(resource),
+    sumWeights(resource),
+    sumWeightLogs(resource),
+    heap(resource),
+    worklist(this->graph->size(), resource),
+    marks(this->graph->size(), 0, resource),
+    trail(resource),
+    decisions(resource),
+    supports(resource),
+    allowed(Bitset::getWords(states.size()), resource),
+    removed(Bitset::getWords(states.size()), resource),
+    candidates(resource),
+    cumulativeWeights(resource),
+    region(resource),
+    owners(resource),
+    visits(resource),
+    saved(resource)
+{
+    this->sumWeights.reserve(this->size());
+    this->sumWeightLogs.reserve(this->size());
+    this->candidates.reserve(states.size());
+    this->cumulativeWeights.reserve(states.size());
+    this->heap.assign(this->size());
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        Bitset::fill(this->getDomain(i), states.size());
+        this->setSize(i, states.size());
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::collapse(unsigned int seed)
+{
+    Topology::check(this->tryCollapse(seed));
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine, class>
+void Topology<State, GraphType, Observer>::collapse(Engine& randGen)
+{
+    Topology::check(this->collapse(randGen, nullptr));
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::tryCollapse(unsigned int seed)
+{
+    Random::SplitMix64 randGen(seed);
+    return this->collapse(randGen, nullptr);
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine, class>
+Result Topology<State, GraphType, Observer>::tryCollapse(Engine& randGen)
+{
+    return this->collapse(randGen, nullptr);
+}
+
+template <class State, class GraphType, class Observer>
+unsigned int Topology<State, GraphType, Observer>::collapsePortfolio(const std::vector<unsigned int>& seeds, size_t threads)
+{
+    std::atomic<size_t> next = 0;
+    std::atomic<bool> done = false;
+    std::optional<Topology> result;
+    unsigned int resultSeed = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    auto work = [&]()
+    {
+        // The copy of each thread is reused, so later attempts copy into its allocated memory
+        Topology attempt;
+        for (size_t i = next++; i < seeds.size() && !done; i = next++)
+        {
+            try
+            {
+                attempt = *this;
+                Random::SplitMix64 randGen(seeds[i]);
+                Status status = attempt.collapse(randGen, &done).status;
+                if (status == Status::Cancelled)
+                {
+                    return;
+                }
+
+                if (status != Status::Success)
+                {
+                    continue;
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = std::current_exception();
+                done = true;
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!done)
+            {
+                result = std::move(attempt);
+                resultSeed = seeds[i];
+                done = true;
+            }
+
+            return;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < std::min(std::max<size_t>(threads, 1), seeds.size()); t++)
+    {
+        workers.emplace_back(work);
+    }
+
+    work();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    if (!result)
+    {
+        throw std::runtime_error("No valid states");
+    }
+
+    *this = std::move(*result);
+    return resultSeed;
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::collapseBatched(size_t batch, size_t distance, unsigned int seed, size_t threads)
+{
+    Topology::check(this->tryCollapseBatched(batch, distance, seed, threads));
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::tryCollapseBatched(size_t batch, size_t distance, unsigned int seed, size_t threads)
+{
+    Random::SplitMix64 randGen(seed);
+    return this->tryCollapseBatched(batch, distance, randGen, threads);
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine, class>
+Result Topology<State, GraphType, Observer>::tryCollapseBatched(size_t batch, size_t distance, Engine& randGen, size_t threads)
+{
+    this->initialize(randGen);
+    return this->searchBatched(batch, distance, randGen, threads);
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::repair(const std::vector<size_t>& nodes, size_t margin, unsigned int seed)
+{
+    Random::SplitMix64 randGen(seed);
+    this->repair(nodes, margin, randGen);
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine, class>
+void Topology<State, GraphType, Observer>::repair(const std::vector<size_t>& nodes, size_t margin, Engine& randGen)
+{
+    Topology::check(this->tryRepair(nodes, margin, randGen));
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::tryRepair(const std::vector<size_t>& nodes, size_t margin, unsigned int seed)
+{
+    Random::SplitMix64 randGen(seed);
+    return this->tryRepair(nodes, margin, randGen);
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine, class>
+Result Topology<State, GraphType, Observer>::tryRepair(const std::vector<size_t>& nodes, size_t margin, Engine& randGen)
+{
+    this->resolveWeights();
+    if (this->sumWeights.size() != this->size())
+    {
+        this->sumWeights.assign(this->size(), 0);
+        this->sumWeightLogs.assign(this->size(), 0);
+        for (size_t i = 0; i < this->size(); i++)
+        {
+            this->sumNode(i);
+        }
+    }
+
+    // The region contains the nodes and the nodes within the margin, a node is in the region if its mark is equal to the epoch
+    this->nextEpoch();
+    std::pmr::vector<size_t>& region = this->region;
+    region.clear();
+    for (size_t node : nodes)
+    {
+        if (this->marks[node] != this->epoch)
+        {
+            this->marks[node] = this->epoch;
+            region.push_back(node);
+        }
+    }
+
+    for (size_t step = 0, begin = 0; step < margin; step++)
+    {
+        size_t end = region.size();
+        for (size_t i = begin; i < end; i++)
+        {
+            for (size_t d = 0; d < this->graph->getDegree(region[i]); d++)
+            {
+                uint32_t b = this->graph->getAdjacent(region[i], d);
+                if (b != GraphType::none && this->marks[b] != this->epoch)
+                {
+                    this->marks[b] = this->epoch;
+                    region.push_back(b);
+                }
+            }
+        }
+
+        begin = end;
+    }
+
+    // The nodes around the region are saved with it but not reset, only these nodes change when the nodes outside the region are collapsed
+    size_t count = region.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t d = 0; d < this->graph->getDegree(region[i]); d++)
+        {
+            uint32_t b = this->graph->getAdjacent(region[i], d);
+            if (b != GraphType::none && this->marks[b] != this->epoch)
+            {
+                this->marks[b] = this->epoch;
+                region.push_back(b);
+            }
+        }
+    }
+
+    this->saved.resize(region.size() * this->words);
+    for (size_t i = 0; i < region.size(); i++)
+    {
+        std::copy(this->getDomain(region[i]), this->getDomain(region[i]) + this->words, &this->saved[i * this->words]);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t node = region[i];
+        this->sizes[node] = this->fillDomain(node);
+        this->sumNode(node);
+        this->noise[node] = Random::canonical(randGen);
+        this->setSize(node, this->sizes[node]);
+    }
+
+    // Remove the states that are not compatible with the nodes around the region
+    this->trail.clear();
+    this->propagated = 0;
+    bool valid = true;
+    if (this->isCounting())
+    {
+        const Compiled& c = *this->compiled;
+        this->countSupports(region.data(), count);
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t a = region[i];
+            for (size_t d = 0; d < this->graph->getDegree(a); d++)
+            {
+                uint32_t b = this->graph->getAdjacent(a, d);
+                if (b == GraphType::none)
+                {
+                    continue;
+                }
+
+                size_t r = c.opposite[this->graph->getSlot(a) + d];
+                for (size_t s = 0; s < this->states.size() && valid; s++)
+                {
+                    if (this->supports[(this->graph->getSlot(a) + d) * this->states.size() + s] == 0 && Bitset::test(this->getDomain(a), s))
+                    {
+                        valid = this->ban(a, s);
+                    }
+
+                    if (valid && this->supports[(this->graph->getSlot(b) + r) * this->states.size() + s] == 0 && Bitset::test(this->getDomain(b), s))
+                    {
+                        valid = this->ban(b, s);
+                    }
+                }
+            }
+        }
+
+        valid = valid && this->propagateCompiled();
+    }
+    else
+    {
+        for (size_t i = 0; i < count && valid; i++)
+        {
+            bool changed;
+            valid = this->reduceStates(region[i], changed) && (!changed || this->propagate(region[i]));
+        }
+    }
+
+    if (!valid)
+    {
+        this->observer.onContradiction();
+        this->restoreDomains(region.data(), region.size(), this->saved.data());
+        return { Status::Contradiction, this->conflict };
+    }
+
+    Result result = this->search(randGen, nullptr);
+    if (!result)
+    {
+        this->restoreDomains(region.data(), region.size(), this->saved.data());
+    }
+
+    return result;
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::check(const Result& result)
+{
+    if (result.status == Status::Exhausted)
+    {
+        throw std::runtime_error("Backtracks exhausted");
+    }
+
+    if (!result)
+    {
+        throw std::runtime_error("No valid states");
+    }
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine>
+Result Topology<State, GraphType, Observer>::collapse(Engine& randGen, const std::atomic<bool>* cancelled)
+{
+    this->initialize(randGen);
+    return this->search(randGen, cancelled);
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine>
+void Topology<State, GraphType, Observer>::initialize(Engine& randGen)
+{
+    this->resolveWeights();
+    this->sumWeights.assign(this->size(), 0);
+    this->sumWeightLogs.assign(this->size(), 0);
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        this->sumNode(i);
+        this->noise[i] = Random::canonical(randGen);
+        this->setSize(i, this->sizes[i]);
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::resolveWeights()
+{
+    this->stateWeights.resize((this->weightTables.size() + 1) * this->states.size());
+    this->stateWeightLogs.resize((this->weightTables.size() + 1) * this->states.size());
+    for (size_t t = 0; t <= this->weightTables.size(); t++)
+    {
+        this->getResolvedWeights(t, &this->stateWeights[t * this->states.size()], &this->stateWeightLogs[t * this->states.size()]);
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::getResolvedWeights(size_t table, double* weights, double* weightLogs) const
+{
+    const std::map<State, float>& overrides = this->getWeights(table);
+    for (size_t s = 0; s < this->states.size(); s++)
+    {
+        auto it = this->weights.find(this->states[s]);
+        double weight = it != this->weights.end() ? std::max<double>(it->second, 0) : 1;
+        if (table != 0)
+        {
+            auto override = overrides.find(this->states[s]);
+            weight = override != overrides.end() ? std::max<double>(override->second, 0) : weight;
+        }
+
+        weights[s] = weight;
+        weightLogs[s] = weight > 0 ? weight * std::log(weight) : 0;
+    }
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::getWeightRow(size_t node) const
+{
+    return this->weightIndices.empty() ? 0 : this->weightIndices[node] * this->states.size();
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::fillDomain(size_t node)
+{
+    uint64_t* domain = this->getDomain(node);
+    Bitset::fill(domain, this->states.size());
+    if (this->maskIndices.empty() || this->maskIndices[node] == 0)
+    {
+        return this->states.size();
+    }
+
+    const uint64_t* mask = &this->masks[(this->maskIndices[node] - 1) * this->words];
+    for (size_t w = 0; w < this->words; w++)
+    {
+        domain[w] &= mask[w];
+    }
+
+    return Bitset::count(domain, this->words);
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::sumNode(size_t node)
+{
+    this->sumWeights[node] = 0;
+    this->sumWeightLogs[node] = 0;
+    size_t row = this->getWeightRow(node);
+    Bitset::forEach(
+        this->getDomain(node),
+        this->words,
+        [this, node, row](size_t s)
+        {
+            this->sumWeights[node] += this->stateWeights[row + s];
+            this->sumWeightLogs[node] += this->stateWeightLogs[row + s];
+        });
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::nextEpoch()
+{
+    // A new epoch invalidates the marks left by a propagation that was interrupted by a contradiction
+    if (++this->epoch == 0)
+    {
+        std::fill(this->marks.begin(), this->marks.end(), 0);
+        this->epoch = 1;
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::countSupports(const size_t* nodes, size_t count)
+{
+    // Count the supports in both directions of every edge of the nodes
+    const Compiled& c = *this->compiled;
+    size_t rowSize = this->states.size() * this->words;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t a = nodes[i];
+        for (size_t d = 0; d < this->graph->getDegree(a); d++)
+        {
+            uint32_t b = this->graph->getAdjacent(a, d);
+            if (b == GraphType::none)
+            {
+                continue;
+            }
+
+            size_t r = c.opposite[this->graph->getSlot(a) + d];
+            for (size_t s = 0; s < this->states.size(); s++)
+            {
+                this->supports[(this->graph->getSlot(a) + d) * this->states.size() + s] = Bitset::countCommon(&c.rules[d * rowSize + s * this->words], this->getDomain(b), this->words);
+                this->supports[(this->graph->getSlot(b) + r) * this->states.size() + s] = Bitset::countCommon(&c.rules[r * rowSize + s * this->words], this->getDomain(a), this->words);
+            }
+        }
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::restoreDomains(const size_t* nodes, size_t count, const uint64_t* domains)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        std::copy(domains + i * this->words, domains + (i + 1) * this->words, this->getDomain(nodes[i]));
+        this->sumNode(nodes[i]);
+        this->setSize(nodes[i], Bitset::count(this->getDomain(nodes[i]), this->words));
+    }
+
+    if (this->isCounting())
+    {
+        this->countSupports(nodes, count);
+    }
+
+    this->trail.clear();
+    this->propagated = 0;
+    this->decisions.clear();
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine>
+Result Topology<State, GraphType, Observer>::search(Engine& randGen, const std::atomic<bool>* cancelled)
+{
+    this->trail.clear();
+    this->propagated = 0;
+    this->decisions.clear();
+    size_t backtracked = 0;
+    while (!this->isCollapsed())
+    {
+        if (cancelled && cancelled->load(std::memory_order_relaxed))
+        {
+            return { Status::Cancelled, Result::none };
+        }
+
+        this->observer.onBegin(Phase::Selection);
+        size_t node = this->getMinEntropy();
+        size_t state = this->getState(node, randGen);
+        this->observer.onEnd(Phase::Selection);
+        bool valid = state != this->states.size();
+        if (valid)
+        {
+            this->observer.onStep(node, state);
+            if (this->backtracks != 0)
+            {
+                this->decisions.push_back({ this->trail.size(), node, state });
+            }
+
+            valid = this->assign(node, state);
+        }
+        else
+        {
+            this->conflict = node;
+        }
+
+        if (!valid)
+        {
+            Result result = this->backtrack(backtracked);
+            if (!result)
+            {
+                return result;
+            }
+        }
+
+        if (this->backtracks == 0)
+        {
+            this->trail.clear();
+            this->propagated = 0;
+        }
+    }
+
+    return {};
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::backtrack(size_t& backtracked)
+{
+    // Undo the last decision and remove its state instead until the topology is valid again
+    bool valid = false;
+    while (!valid)
+    {
+        this->observer.onContradiction();
+        if (this->decisions.empty())
+        {
+            return { Status::Contradiction, this->conflict };
+        }
+
+        if (backtracked++ == this->backtracks)
+        {
+            return { Status::Exhausted, this->conflict };
+        }
+
+        Decision decision = this->decisions.back();
+        this->decisions.pop_back();
+        this->observer.onBacktrack(decision.node, decision.state);
+        this->observer.onBegin(Phase::Backtracking);
+        this->undo(decision.trail);
+        valid = this->ban(decision.node, decision.state);
+        this->observer.onEnd(Phase::Backtracking);
+        valid = valid && this->propagate(decision.node);
+    }
+
+    return {};
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine>
+Result Topology<State, GraphType, Observer>::searchBatched(size_t batch, size_t distance, Engine& randGen, size_t threads)
+{
+    this->trail.clear();
+    this->propagated = 0;
+    this->decisions.clear();
+    batch = std::max<size_t>(std::min(batch, this->size()), 1);
+    Workers workers(std::min(std::max<size_t>(threads, 1), batch));
+
+    // The region of the w-th wave of a step are the nodes whose owner is claim + w, older owners are smaller than claim
+    std::vector<Wave> waves(batch);
+    std::pmr::vector<uint32_t>& owners = this->owners;
+    std::pmr::vector<uint32_t>& visits = this->visits;
+    owners.assign(this->size(), 0);
+    visits.assign(this->size(), 0);
+    std::vector<std::pair<size_t, size_t>> ball;
+    std::pmr::vector<size_t> lowest(this->getResource()), frontier(this->getResource());
+    uint32_t claim = 1, visit = 0;
+    size_t backtracked = 0;
+    for (; !this->isCollapsed(); claim += batch)
+    {
+        if (claim > UINT32_MAX - batch)
+        {
+            std::fill(owners.begin(), owners.end(), 0);
+            claim = 1;
+        }
+
+        // Decide the nodes with the lowest entropy whose nodes within distance + 1 are not in the region of another wave
+        this->observer.onBegin(Phase::Selection);
+        size_t failed = Result::none, count = 0;
+        this->heap.getSmallest(4 * batch, lowest, frontier);
+        for (size_t i = 0; i < lowest.size() && count < batch; i++)
+        {
+            size_t node = lowest[i];
+            if (++visit == 0)
+            {
+                std::fill(visits.begin(), visits.end(), 0);
+                visit = 1;
+            }
+
+            bool free = owners[node] < claim;
+            ball.assign(1, { node, 0 });
+            visits[node] = visit;
+            for (size_t j = 0; j < ball.size() && free; j++)
+            {
+                auto [a, depth] = ball[j];
+                for (size_t d = 0; d < this->graph->getDegree(a) && depth <= distance && free; d++)
+                {
+                    uint32_t b = this->graph->getAdjacent(a, d);
+                    if (b != GraphType::none && visits[b] != visit)
+                    {
+                        visits[b] = visit;
+                        free = owners[b] < claim;
+                        ball.emplace_back(b, depth + 1);
+                    }
+                }
+            }
+
+            if (!free)
+            {
+                continue;
+            }
+
+            // Like collapse(), a node without valid states is a contradiction if it is the first node of the step
+            size_t state = this->getState(node, randGen);
+            if (state == this->states.size())
+            {
+                if (count == 0)
+                {
+                    failed = node;
+                    break;
+                }
+
+                continue;
+            }
+
+            for (auto [a, depth] : ball)
+            {
+                if (depth <= distance)
+                {
+                    owners[a] = claim + count;
+                }
+            }
+
+            waves[count].node = node;
+            waves[count].state = state;
+            count++;
+        }
+
+        this->observer.onEnd(Phase::Selection);
+        bool valid = failed == Result::none;
+        if (!valid)
+        {
+            this->conflict = failed;
+        }
+        else
+        {
+            // The waves only write to their regions and read the nodes adjacent to them, which are outside every region
+            this->nextEpoch();
+            this->observer.onBegin(Phase::Propagation);
+            workers.forEach(
+                count,
+                1,
+                [this, &waves, &owners, claim](size_t begin, size_t end, size_t)
+                {
+                    for (size_t w = begin; w < end; w++)
+                    {
+                        this->propagateWave(waves[w], owners, claim + w);
+                    }
+                });
+
+            this->observer.onEnd(Phase::Propagation);
+        }
+
+        // A removal in or next to the region of a later wave may depend on the changes of that wave, so the waves collide
+        size_t w = 0;
+        auto collides = [this, &owners, claim, &count, &w](size_t node)
+        {
+            auto isLater = [&owners, claim, &count, &w](size_t a) { return owners[a] > claim + w && owners[a] < claim + count; };
+            bool later = isLater(node);
+            for (size_t d = 0; d < this->graph->getDegree(node) && !later; d++)
+            {
+                uint32_t b = this->graph->getAdjacent(node, d);
+                later = b != GraphType::none && isLater(b);
+            }
+
+            return later;
+        };
+
+        for (; w < count && valid; w++)
+        {
+            Wave& wave = waves[w];
+            this->observer.onStep(wave.node, wave.state);
+            size_t mark = this->trail.size();
+            if (this->backtracks != 0)
+            {
+                this->decisions.push_back({ mark, wave.node, wave.state });
+            }
+
+            for (size_t node : wave.reduced)
+            {
+                this->observer.onReduce(node);
+            }
+
+            for (size_t i = 0; i < wave.compatibleCalls; i++)
+            {
+                this->observer.onCompatible();
+            }
+
+            if (wave.conflict != Result::none)
+            {
+                // The region of the wave is unchanged since the wave was propagated, so its decision contradicts
+                this->restoreWave(wave);
+                this->conflict = wave.conflict;
+                valid = false;
+                continue;
+            }
+
+            // The removals of a node are consecutive, so the heap is updated once per node
+            for (size_t i = 0; i < wave.removals.size(); i++)
+            {
+                auto [node, state] = wave.removals[i];
+                this->trail.emplace_back(node, state);
+                this->observer.onRemove(node, state);
+                if (i + 1 == wave.removals.size() || wave.removals[i + 1].first != node)
+                {
+                    this->setSize(node, this->sizes[node]);
+                }
+            }
+
+            this->observer.onWave(this->isCounting() ? wave.removals.size() : wave.worklist.size());
+
+            // Continue the wave past its region from the removals it found outside the region, or from its boundary without compiled rules
+            if (this->isCounting())
+            {
+                this->propagated = this->trail.size();
+            }
+
+            size_t outside = this->trail.size();
+            for (auto [node, state] : wave.pending)
+            {
+                if (valid && Bitset::test(this->getDomain(node), state))
+                {
+                    valid = this->ban(node, state);
+                }
+            }
+
+            if (this->compiled)
+            {
+                wave.boundary.clear();
+                for (size_t i = outside; i < this->trail.size(); i++)
+                {
+                    wave.boundary.push_back(this->trail[i].first);
+                }
+            }
+
+            valid = valid && this->propagate(wave.boundary.data(), wave.boundary.size());
+            bool collided = !valid && collides(this->conflict);
+            for (size_t i = mark + wave.removals.size(); i < this->trail.size() && !collided; i++)
+            {
+                collided = collides(this->trail[i].first);
+            }
+
+            if (collided)
+            {
+                // Propagate the decision again without the later waves, which are decided again in the next steps
+                for (size_t later = w + 1; later < count; later++)
+                {
+                    this->restoreWave(waves[later]);
+                }
+
+                this->undo(mark);
+                count = w + 1;
+                valid = this->assign(wave.node, wave.state);
+            }
+        }
+
+        // The waves after a contradiction are undone and decided again in the next steps
+        for (; w < count; w++)
+        {
+            this->restoreWave(waves[w]);
+        }
+
+        if (!valid)
+        {
+            Result result = this->backtrack(backtracked);
+            if (!result)
+            {
+                return result;
+            }
+        }
+
+        if (this->backtracks == 0)
+        {
+            this->trail.clear();
+            this->propagated = 0;
+        }
+    }
+
+    return {};
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::propagateWave(Wave& wave, const std::pmr::vector<uint32_t>& owners, uint32_t owner)
+{
+    wave.removals.clear();
+    wave.processed = 0;
+    wave.worklist.clear();
+    wave.boundary.clear();
+    wave.pending.clear();
+    wave.reduced.clear();
+    wave.compatibleCalls = 0;
+    wave.allowed.resize(this->words);
+    wave.removed.resize(this->words);
+    wave.conflict = Result::none;
+
+    // Remove the other states of the decided node
+    const uint64_t* domain = this->getDomain(wave.node);
+    for (size_t w = 0; w < this->words; w++)
+    {
+        uint64_t remove = domain[w];
+        if (w == wave.state / 64)
+        {
+            remove &= ~(uint64_t(1) << (wave.state % 64));
+        }
+
+        Bitset::forEach(&remove, 1, [this, &wave, w](size_t s) { this->eraseInWave(wave, wave.node, w * 64 + s); });
+    }
+
+    if (this->isCounting())
+    {
+        // Like propagateCompiled, the states outside the region without support are removed when the wave is merged
+        const Compiled& c = *this->compiled;
+        size_t rowSize = this->states.size() * this->words;
+        bool valid = true;
+        while (valid && wave.processed < wave.removals.size())
+        {
+            auto [b, sb] = wave.removals[wave.processed++];
+            for (size_t r = 0; r < this->graph->getDegree(b); r++)
+            {
+                size_t a = this->graph->getAdjacent(b, r);
+                if (a == GraphType::none)
+                {
+                    continue;
+                }
+
+                size_t d = c.opposite[this->graph->getSlot(b) + r];
+                uint32_t* supports = &this->supports[(this->graph->getSlot(a) + d) * this->states.size()];
+                const uint64_t* aDomain = this->getDomain(a);
+                bool inside = owners[a] == owner;
+                Bitset::forEach(
+                    &c.transposed[d * rowSize + sb * this->words],
+                    this->words,
+                    [this, &wave, a, supports, aDomain, inside, &valid](size_t sa)
+                    {
+                        if (--supports[sa] == 0 && valid && Bitset::test(aDomain, sa))
+                        {
+                            if (inside)
+                            {
+                                valid = this->eraseInWave(wave, a, sa);
+                            }
+                            else
+                            {
+                                wave.pending.emplace_back(a, sa);
+                            }
+                        }
+                    });
+            }
+        }
+
+        return;
+    }
+
+    // Like propagateWorklist, the nodes outside the region are reduced when the wave is merged
+    wave.worklist.push_back(wave.node);
+    this->marks[wave.node] = this->epoch;
+    for (size_t head = 0; head < wave.worklist.size(); head++)
+    {
+        size_t current = wave.worklist[head];
+        this->marks[current] = 0;
+        bool outside = false;
+        for (size_t d = 0; d < this->graph->getDegree(current); d++)
+        {
+            size_t index = this->graph->getAdjacent(current, d);
+            if (index == GraphType::none)
+            {
+                continue;
+            }
+
+            if (owners[index] != owner)
+            {
+                outside = true;
+                continue;
+            }
+
+            bool changed = false;
+            wave.reduced.push_back(index);
+            if (this->compiled)
+            {
+                switch (this->intersectMasks(current, d, index, wave.allowed.data(), wave.removed.data()))
+                {
+                case Kernels::Intersection::Unchanged:
+                    break;
+                case Kernels::Intersection::Empty:
+                    wave.conflict = index;
+                    return;
+                default:
+                    Bitset::forEach(wave.removed.data(), this->words, [this, &wave, index](size_t s) { this->eraseInWave(wave, index, s); });
+                    changed = true;
+                    break;
+                }
+            }
+            else
+            {
+                Bitset::forEach(
+                    this->getDomain(index),
+                    this->words,
+                    [this, &wave, index, &changed](size_t s)
+                    {
+                        if (wave.conflict == Result::none && !this->isPlaceable(index, s, &wave.compatibleCalls))
+                        {
+                            this->eraseInWave(wave, index, s);
+                            changed = true;
+                        }
+                    });
+
+                if (wave.conflict != Result::none)
+                {
+                    return;
+                }
+            }
+
+            if (changed && this->marks[index] != this->epoch)
+            {
+                wave.worklist.push_back(index);
+                this->marks[index] = this->epoch;
+            }
+        }
+
+        if (outside)
+        {
+            wave.boundary.push_back(current);
+        }
+    }
+
+    // The compiled rules only read the boundary and the nodes outside the region, so the removals outside the region are found here
+    if (this->compiled)
+    {
+        std::sort(wave.boundary.begin(), wave.boundary.end());
+        wave.boundary.erase(std::unique(wave.boundary.begin(), wave.boundary.end()), wave.boundary.end());
+        for (size_t current : wave.boundary)
+        {
+            for (size_t d = 0; d < this->graph->getDegree(current); d++)
+            {
+                size_t index = this->graph->getAdjacent(current, d);
+                if (index == GraphType::none || owners[index] == owner)
+                {
+                    continue;
+                }
+
+                wave.reduced.push_back(index);
+                if (this->intersectMasks(current, d, index, wave.allowed.data(), wave.removed.data()) != Kernels::Intersection::Unchanged)
+                {
+                    Bitset::forEach(wave.removed.data(), this->words, [&wave, index](size_t s) { wave.pending.emplace_back(index, s); });
+                }
+            }
+        }
+    }
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::eraseInWave(Wave& wave, size_t node, size_t state)
+{
+    // Like erase, without the trail and the observer, which are only used on the calling thread
+    if (this->sizes[node] == 1)
+    {
+        wave.conflict = node;
+        return false;
+    }
+
+    this->removeState(node, state);
+    wave.removals.emplace_back(node, state);
+    return true;
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::restoreWave(const Wave& wave)
+{
+    // Like undo, for a wave that is not on the trail
+    for (size_t i = wave.removals.size(); i-- > 0;)
+    {
+        auto [node, state] = wave.removals[i];
+        this->restoreState(node, state, i < wave.processed);
+        if (i == 0 || wave.removals[i - 1].first != node)
+        {
+            this->setSize(node, this->sizes[node]);
+        }
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::removeState(size_t node, size_t state)
+{
+    // Shared by erase and eraseInWave, the size is passed to the heap by the caller
+    Bitset::reset(this->getDomain(node), state);
+    this->sizes[node]--;
+    if (this->sumWeights.size() == this->size())
+    {
+        this->sumWeights[node] -= this->stateWeights[this->getWeightRow(node) + state];
+        this->sumWeightLogs[node] -= this->stateWeightLogs[this->getWeightRow(node) + state];
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::restoreState(size_t node, size_t state, bool supported)
+{
+    // Shared by undo and restoreWave, a removal that was subtracted from the support counters is added back
+    if (this->isCounting() && supported)
+    {
+        this->updateSupports(node, state, 1);
+    }
+
+    Bitset::set(this->getDomain(node), state);
+    this->sizes[node]++;
+    if (this->sumWeights.size() == this->size())
+    {
+        this->sumWeights[node] += this->stateWeights[this->getWeightRow(node) + state];
+        this->sumWeightLogs[node] += this->stateWeightLogs[this->getWeightRow(node) + state];
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::collapseNode(size_t node, const State& state)
+{
+    Topology::check(this->tryCollapseNode(node, state));
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::tryCollapseNode(size_t node, const State& state)
+{
+    size_t stateIndex = this->getStateIndex(state);
+    if (stateIndex == this->states.size() || !Bitset::test(this->getDomain(node), stateIndex))
+    {
+        throw std::logic_error("Invalid state to collapse");
+    }
+
+    this->trail.clear();
+    this->propagated = 0;
+    bool valid = this->assign(node, stateIndex);
+    return this->endChange(valid);
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::restrictNode(size_t node, const std::vector<State>& states)
+{
+    Topology::check(this->tryRestrictNode(node, states));
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::tryRestrictNode(size_t node, const std::vector<State>& states)
+{
+    size_t count = this->getRemoved(node, states.data(), states.size());
+    if (count == this->sizes[node])
+    {
+        throw std::logic_error("Invalid states to restrict");
+    }
+
+    if (count == 0)
+    {
+        return {};
+    }
+
+    this->trail.clear();
+    this->propagated = 0;
+    Bitset::forEach(this->removed.data(), this->words, [this, node](size_t s) { this->erase(node, s); });
+    this->setSize(node, this->sizes[node]);
+    bool valid = this->propagate(node);
+    return this->endChange(valid);
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::collapseNodes(const std::vector<std::pair<size_t, State>>& assignments)
+{
+    Topology::check(this->tryCollapseNodes(assignments));
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::tryCollapseNodes(const std::vector<std::pair<size_t, State>>& assignments)
+{
+    this->trail.clear();
+    this->propagated = 0;
+    this->region.clear();
+    for (const auto& [node, state] : assignments)
+    {
+        size_t stateIndex = this->getStateIndex(state);
+        if (stateIndex == this->states.size() || !Bitset::test(this->getDomain(node), stateIndex))
+        {
+            // Leave the nodes unchanged
+            this->undo(0);
+            throw std::logic_error("Invalid state to collapse");
+        }
+
+        if (this->sizes[node] > 1)
+        {
+            this->getRemoved(node, &state, 1);
+            Bitset::forEach(this->removed.data(), this->words, [this, node](size_t s) { this->erase(node, s); });
+            this->setSize(node, 1);
+            this->region.push_back(node);
+        }
+    }
+
+    return this->propagateBatch();
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::restrictNodes(const std::vector<std::pair<size_t, std::vector<State>>>& restrictions)
+{
+    Topology::check(this->tryRestrictNodes(restrictions));
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::tryRestrictNodes(const std::vector<std::pair<size_t, std::vector<State>>>& restrictions)
+{
+    this->trail.clear();
+    this->propagated = 0;
+    this->region.clear();
+    for (const auto& [node, states] : restrictions)
+    {
+        size_t count = this->getRemoved(node, states.data(), states.size());
+        if (count == this->sizes[node])
+        {
+            // Leave the nodes unchanged
+            this->undo(0);
+            throw std::logic_error("Invalid states to restrict");
+        }
+
+        if (count != 0)
+        {
+            Bitset::forEach(this->removed.data(), this->words, [this, node](size_t s) { this->erase(node, s); });
+            this->setSize(node, this->sizes[node]);
+            this->region.push_back(node);
+        }
+    }
+
+    return this->propagateBatch();
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::restrictNodes(const std::vector<size_t>& nodes, const std::vector<State>& states)
+{
+    Topology::check(this->tryRestrictNodes(nodes, states));
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::tryRestrictNodes(const std::vector<size_t>& nodes, const std::vector<State>& states)
+{
+    // The states to keep are looked up once for all nodes
+    uint64_t* keep = this->allowed.data();
+    std::fill(keep, keep + this->words, 0);
+    for (const State& state : states)
+    {
+        size_t stateIndex = this->getStateIndex(state);
+        if (stateIndex != this->states.size())
+        {
+            Bitset::set(keep, stateIndex);
+        }
+    }
+
+    this->trail.clear();
+    this->propagated = 0;
+    this->region.clear();
+    for (size_t node : nodes)
+    {
+        if (Bitset::countCommon(keep, this->getDomain(node), this->words) == 0)
+        {
+            // Leave the nodes unchanged
+            this->undo(0);
+            throw std::logic_error("Invalid states to restrict");
+        }
+
+        const uint64_t* domain = this->getDomain(node);
+        uint64_t* remove = this->removed.data();
+        for (size_t w = 0; w < this->words; w++)
+        {
+            remove[w] = domain[w] & ~keep[w];
+        }
+
+        if (Bitset::count(remove, this->words) != 0)
+        {
+            Bitset::forEach(remove, this->words, [this, node](size_t s) { this->erase(node, s); });
+            this->setSize(node, this->sizes[node]);
+            this->region.push_back(node);
+        }
+    }
+
+    return this->propagateBatch();
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::getRemoved(size_t node, const State* states, size_t count)
+{
+    // The states of the domain that are not in the list
+    uint64_t* remove = this->removed.data();
+    std::copy(this->getDomain(node), this->getDomain(node) + this->words, remove);
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t stateIndex = this->getStateIndex(states[i]);
+        if (stateIndex != this->states.size())
+        {
+            Bitset::reset(remove, stateIndex);
+        }
+    }
+
+    return Bitset::count(remove, this->words);
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::propagateBatch()
+{
+    // The removals of all changed nodes are propagated by one wave
+    bool valid = this->region.empty() || this->propagate(this->region.data(), this->region.size());
+    return this->endChange(valid);
+}
+
+template <class State, class GraphType, class Observer>
+Result Topology<State, GraphType, Observer>::endChange(bool valid)
+{
+    // A contradiction undoes the removals of the change, so the nodes are left unchanged and the topology can be used again without reset
+    if (!valid)
+    {
+        this->undo(0);
+        this->observer.onContradiction();
+        return { Status::Contradiction, this->conflict };
+    }
+
+    this->trail.clear();
+    this->propagated = 0;
+    return {};
+}
+
+template <class State, class GraphType, class Observer>
+double Topology<State, GraphType, Observer>::getEntropy(size_t node) const
+{
+    if (this->heuristic == Heuristic::Count || this->sumWeights.size() != this->size())
+    {
+        return this->sizes[node] + this->noise[node];
+    }
+
+    return Topology::getEntropy(this->sumWeights[node], this->sumWeightLogs[node], this->noise[node]);
+}
+
+template <class State, class GraphType, class Observer>
+double Topology<State, GraphType, Observer>::getEntropy(double sum, double sumLogs, double noise)
+{
+    // H = log(sum(w)) - sum(w * log(w)) / sum(w)
+    double entropy = sum > 0 ? std::log(sum) - sumLogs / sum : 0;
+    return entropy + noise * 1e-6;
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::erase(size_t node, size_t state)
+{
+    if (this->sizes[node] == 1)
+    {
+        this->conflict = node;
+        return false;
+    }
+
+    this->removeState(node, state);
+    this->trail.emplace_back(node, state);
+    this->observer.onRemove(node, state);
+    return true;
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::ban(size_t node, size_t state)
+{
+    if (!this->erase(node, state))
+    {
+        return false;
+    }
+
+    this->setSize(node, this->sizes[node]);
+    return true;
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::undo(size_t trail)
+{
+    while (this->trail.size() > trail)
+    {
+        auto [node, state] = this->trail.back();
+        this->trail.pop_back();
+        this->restoreState(node, state, this->trail.size() < this->propagated);
+        this->setSize(node, this->sizes[node]);
+    }
+
+    this->propagated = std::min(this->propagated, trail);
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::assign(size_t node, size_t state)
+{
+    const uint64_t* domain = this->getDomain(node);
+    for (size_t w = 0; w < this->words; w++)
+    {
+        uint64_t remove = domain[w];
+        if (w == state / 64)
+        {
+            remove &= ~(uint64_t(1) << (state % 64));
+        }
+
+        Bitset::forEach(&remove, 1, [this, node, w](size_t s) { this->erase(node, w * 64 + s); });
+    }
+
+    this->setSize(node, 1);
+    return this->propagate(node);
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::compile()
+{
+    this->observer.onBegin(Phase::Compilation);
+    try
+    {
+        this->compileTables(nullptr);
+    }
+    catch (const std::runtime_error&)
+    {
+        this->observer.onContradiction();
+        this->observer.onEnd(Phase::Compilation);
+        throw;
+    }
+
+    this->observer.onEnd(Phase::Compilation);
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::compile(const Topology& other)
+{
+    if (!other.compiled || other.states != this->states)
+    {
+        throw std::logic_error("Invalid topology to compile with");
+    }
+
+    this->observer.onBegin(Phase::Compilation);
+    try
+    {
+        this->compileTables(other.compiled);
+    }
+    catch (const std::runtime_error&)
+    {
+        this->observer.onContradiction();
+        this->observer.onEnd(Phase::Compilation);
+        throw;
+    }
+
+    this->observer.onEnd(Phase::Compilation);
+}
+
+template <class State, class GraphType, class Observer>
+std::vector<uint64_t> Topology<State, GraphType, Observer>::getRules() const
+{
+    if (this->compiled)
+    {
+        return std::vector<uint64_t>(this->compiled->rules, this->compiled->rules + this->compiled->directions * this->states.size() * this->words);
+    }
+
+    return this->evaluateRules();
+}
+
+template <class State, class GraphType, class Observer>
+std::vector<uint64_t> Topology<State, GraphType, Observer>::evaluateRules() const
+{
+    size_t directions = 0;
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        directions = std::max(directions, this->graph->getDegree(i));
+    }
+
+    // Evaluate the compatible function on the first node that has an adjacent node in each direction
+    size_t rowSize = this->states.size() * this->words;
+    std::vector<uint64_t> rules(directions * rowSize, 0);
+    for (size_t d = 0; d < directions; d++)
+    {
+        size_t a = 0;
+        while (a < this->size() && (d >= this->graph->getDegree(a) || this->graph->getAdjacent(a, d) == GraphType::none))
+        {
+            a++;
+        }
+
+        if (a == this->size())
+        {
+            continue;
+        }
+
+        size_t b = this->graph->getAdjacent(a, d);
+        for (size_t sa = 0; sa < this->states.size(); sa++)
+        {
+            for (size_t sb = 0; sb < this->states.size(); sb++)
+            {
+                if (this->isCompatible(a, sa, d, b, sb))
+                {
+                    Bitset::set(&rules[d * rowSize + sa * this->words], sb);
+                }
+            }
+        }
+    }
+
+    return rules;
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::compileTables(const std::shared_ptr<const Compiled>& source)
+{
+    auto c = std::make_shared<Compiled>();
+    this->trail.clear();
+    this->propagated = 0;
+
+    c->directions = 0;
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        c->directions = std::max(c->directions, this->graph->getDegree(i));
+    }
+
+    size_t rowSize = this->states.size() * this->words;
+    if (source)
+    {
+        if (source->directions != c->directions)
+        {
+            throw std::logic_error("Invalid topology to compile with");
+        }
+
+        // The tables of the source are used in place and kept alive by the tables of the topology
+        c->rules = source->rules;
+        c->transposed = source->transposed;
+        c->data = source;
+    }
+    else
+    {
+        // The transposed rules are the rules read from the adjacent node
+        c->ownedRules = this->evaluateRules();
+        c->ownedTransposed.assign(c->ownedRules.size(), 0);
+        c->rules = c->ownedRules.data();
+        c->transposed = c->ownedTransposed.data();
+        for (size_t d = 0; d < c->directions; d++)
+        {
+            for (size_t sa = 0; sa < this->states.size(); sa++)
+            {
+                Bitset::forEach(&c->rules[d * rowSize + sa * this->words], this->words, [&c, d, rowSize, sa, this](size_t sb) { Bitset::set(&c->ownedTransposed[d * rowSize + sb * this->words], sa); });
+            }
+        }
+    }
+
+    // Pair the k-th slot of a pointing to b with the k-th slot of b pointing to a
+    c->ownedOpposite.resize(this->graph->getSlots());
+    c->opposite = c->ownedOpposite.data();
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        for (size_t d = 0; d < this->graph->getDegree(i); d++)
+        {
+            uint32_t b = this->graph->getAdjacent(i, d);
+            if (b == GraphType::none)
+            {
+                continue;
+            }
+
+            size_t k = 0;
+            for (size_t e = 0; e < d; e++)
+            {
+                k += this->graph->getAdjacent(i, e) == b;
+            }
+
+            size_t r = 0, degree = this->graph->getDegree(b);
+            for (size_t n = 0; r < degree; r++)
+            {
+                if (this->graph->getAdjacent(b, r) == i && n++ == k)
+                {
+                    break;
+                }
+            }
+
+            if (r == degree)
+            {
+                throw std::logic_error("Topology is not symmetric");
+            }
+
+            c->ownedOpposite[this->graph->getSlot(i) + d] = r;
+        }
+    }
+
+    this->supports.clear();
+    if (this->propagation != Propagation::Masks)
+    {
+        this->supports.resize(this->graph->getSlots() * this->states.size());
+    }
+
+    this->compiled = std::move(c);
+    this->prune();
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::prune()
+{
+    if (!this->isCounting())
+    {
+        // Reduce every node by the states of its adjacent nodes
+        for (size_t i = 0; i < this->size(); i++)
+        {
+            bool changed;
+            if (!this->reduceStates(i, changed) || (changed && !this->propagate(i)))
+            {
+                this->trail.clear();
+                throw std::runtime_error("No valid states");
+            }
+        }
+
+        this->trail.clear();
+        return;
+    }
+
+    const Compiled& c = *this->compiled;
+    size_t rowSize = this->states.size() * this->words;
+    std::fill(this->supports.begin(), this->supports.end(), 0);
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        for (size_t d = 0; d < this->graph->getDegree(i); d++)
+        {
+            uint32_t b = this->graph->getAdjacent(i, d);
+            if (b == GraphType::none)
+            {
+                continue;
+            }
+
+            for (size_t sa = 0; sa < this->states.size(); sa++)
+            {
+                this->supports[(this->graph->getSlot(i) + d) * this->states.size() + sa] = Bitset::countCommon(&c.rules[d * rowSize + sa * this->words], this->getDomain(b), this->words);
+            }
+        }
+    }
+
+    // Remove the states that are not supported in some direction
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        for (size_t d = 0; d < this->graph->getDegree(i); d++)
+        {
+            if (this->graph->getAdjacent(i, d) == GraphType::none)
+            {
+                continue;
+            }
+
+            for (size_t sa = 0; sa < this->states.size(); sa++)
+            {
+                if (this->supports[(this->graph->getSlot(i) + d) * this->states.size() + sa] == 0 &&
+                    Bitset::test(this->getDomain(i), sa) &&
+                    !this->ban(i, sa))
+                {
+                    throw std::runtime_error("No valid states");
+                }
+            }
+        }
+    }
+
+    bool valid = this->propagateCompiled();
+    this->trail.clear();
+    this->propagated = 0;
+    if (!valid)
+    {
+        throw std::runtime_error("No valid states");
+    }
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::reset()
+{
+    this->trail.clear();
+    this->propagated = 0;
+    this->decisions.clear();
+    this->conflict = Result::none;
+
+    // The sums of the weights are recomputed by the next collapse, without them the heap is ordered by the number of states
+    this->sumWeights.clear();
+    this->sumWeightLogs.clear();
+    this->region.clear();
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        size_t size = this->fillDomain(i);
+        this->setSize(i, size);
+        if (size != this->states.size())
+        {
+            this->region.push_back(i);
+        }
+    }
+
+    // The masked nodes are propagated like restrictNodes, a compiled topology reduces all nodes like compile()
+    if (this->compiled)
+    {
+        this->prune();
+        return;
+    }
+
+    bool valid = this->region.empty() || this->propagate(this->region.data(), this->region.size());
+    this->trail.clear();
+    if (!valid)
+    {
+        throw std::runtime_error("No valid states");
+    }
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::isCompiled() const
+{
+    return this->compiled != nullptr;
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::size() const
+{
+    return this->graph->size();
+}
+
+template <class State, class GraphType, class Observer>
+std::pmr::memory_resource* Topology<State, GraphType, Observer>::getResource() const
+{
+    return this->domains.get_allocator().resource();
+}
+
+template <class State, class GraphType, class Observer>
+StateView<State> Topology<State, GraphType, Observer>::getStates(size_t node) const
+{
+    return StateView<State>(this->states, this->getDomain(node));
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::addWeightTable(const std::map<State, float>& weights)
+{
+    this->weightTables.push_back(weights);
+    return this->weightTables.size();
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::setWeightTable(size_t node, size_t table)
+{
+    if (table > this->weightTables.size())
+    {
+        throw std::out_of_range("Weight table out of range");
+    }
+
+    if (this->weightIndices.empty())
+    {
+        this->weightIndices.assign(this->size(), 0);
+    }
+
+    // The sums of the weights are computed again by the next collapse or repair
+    this->weightIndices[node] = table;
+    this->sumWeights.clear();
+    this->sumWeightLogs.clear();
+}
+
+template <class State, class GraphType, class Observer>
+const std::map<State, float>& Topology<State, GraphType, Observer>::getWeights(size_t table) const
+{
+    if (table > this->weightTables.size())
+    {
+        throw std::out_of_range("Weight table out of range");
+    }
+
+    return table == 0 ? this->weights : this->weightTables[table - 1];
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::getWeightTable(size_t node) const
+{
+    return this->weightIndices.empty() ? 0 : this->weightIndices[node];
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::addMask(const std::vector<State>& states)
+{
+    size_t offset = this->masks.size();
+    this->masks.resize(offset + this->words, 0);
+    for (const State& state : states)
+    {
+        size_t stateIndex = this->getStateIndex(state);
+        if (stateIndex != this->states.size())
+        {
+            Bitset::set(&this->masks[offset], stateIndex);
+        }
+    }
+
+    if (Bitset::count(&this->masks[offset], this->words) == 0)
+    {
+        this->masks.resize(offset);
+        throw std::logic_error("Invalid states to restrict");
+    }
+
+    return this->masks.size() / this->words;
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::setMask(size_t node, size_t mask)
+{
+    if (mask > this->masks.size() / this->words)
+    {
+        throw std::out_of_range("Mask out of range");
+    }
+
+    if (this->maskIndices.empty())
+    {
+        this->maskIndices.assign(this->size(), 0);
+    }
+
+    this->maskIndices[node] = mask;
+}
+
+template <class State, class GraphType, class Observer>
+std::vector<State> Topology<State, GraphType, Observer>::getMaskStates(size_t mask) const
+{
+    if (mask > this->masks.size() / this->words)
+    {
+        throw std::out_of_range("Mask out of range");
+    }
+
+    if (mask == 0)
+    {
+        return this->states;
+    }
+
+    std::vector<State> states;
+    Bitset::forEach(&this->masks[(mask - 1) * this->words], this->words, [this, &states](size_t s) { states.push_back(this->states[s]); });
+    return states;
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::getMask(size_t node) const
+{
+    return this->maskIndices.empty() ? 0 : this->maskIndices[node];
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::isCorrect() const
+{
+    for (size_t a = 0; a < this->size(); a++)
+    {
+        if (this->sizes[a] != 1)
+        {
+            return false;
+        }
+
+        size_t aState = Bitset::first(this->getDomain(a), this->words);
+        for (size_t d = 0; d < this->graph->getDegree(a); d++)
+        {
+            uint32_t b = this->graph->getAdjacent(a, d);
+            if (b == GraphType::none)
+            {
+                continue;
+            }
+
+            size_t bState = Bitset::first(this->getDomain(b), this->words);
+            if (this->sizes[b] != 1 || !this->isPairCorrect(a, aState, d, b, bState))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::isCorrect(const std::vector<State>& states) const
+{
+    if (states.size() != this->size())
+    {
+        return false;
+    }
 
-    /**
-     * @brief Weights are used to bias the selection of states.
-     */
-    std::map<State, float> weights;
+    std::map<State, size_t> indices;
+    for (size_t s = 0; s < this->states.size(); s++)
+    {
+        indices.emplace(this->states[s], s);
+    }
 
-    /**
-     * @brief The compatible function is used to check if two states are compatible.
-     * 
-     * This function has to be defined by the user and should be symmetric ( compatible(a, b) == compatible(b, a) ).
-     * @param a The first node.
-     * @param aState The state of the first node.
-     * @param b The second node.
-     * @param bState The state of the second node.
-     * @return True if the states are compatible, false otherwise.
-     */
-    std::function<bool(const Node<State>&, const State&, const Node<State>&, const State&)> compatible;
+    std::vector<size_t> stateIndices(this->size());
+    for (size_t a = 0; a < this->size(); a++)
+    {
+        auto it = indices.find(states[a]);
+        if (it == indices.end() || !Bitset::test(this->getDomain(a), it->second))
+        {
+            return false;
+        }
 
-    /**
-     * @brief Collapse the topology using the Wave Function Collapse algorithm.
-     * @param seed The seed for the random number generator.
-     * @throw std::runtime_error If no valid states are found.
-     */
-    void collapse(unsigned int seed = time(NULL));
+        stateIndices[a] = it->second;
+    }
 
-    /**
-     * @brief Collapse a node with a specific state.
-     * @param node The node to collapse.
-     * @param state The state to collapse the node with.
-     * @throw std::logic_error If the state is not valid.
-     */
-    void collapseNode(Node<State>& node, const State& state);
+    for (size_t a = 0; a < this->size(); a++)
+    {
+        for (size_t d = 0; d < this->graph->getDegree(a); d++)
+        {
+            uint32_t b = this->graph->getAdjacent(a, d);
+            if (b != GraphType::none && !this->isPairCorrect(a, stateIndices[a], d, b, stateIndices[b]))
+            {
+                return false;
+            }
+        }
+    }
 
-    /**
-     * @brief Check if the topology is correct.
-     * 
-     * A topology is correct if all nodes have only one state and all adjacent nodes are compatible.
-     * 
-     * @return True if the topology is correct, false otherwise.
-     */
-    bool isCorrect() const;
-private:
-    bool isCollapsed() const;
-    Node<State>* getMinEntropy(std::mt19937& randGen);
-    void propagate(Node<State>& node);
-    bool reduceStates(Node<State>& a);
-    State getState(const Node<State>& node, std::mt19937& randGen) const;
-    bool isPlaceable(const Node<State>& node, const State& state) const;
-};
+    return true;
+}
 
-template <class State>
-void Topology<State>::collapse(unsigned int seed)
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::save(std::ostream& stream) const
 {
-    std::mt19937 randGen(seed);
-    while (!this->isCollapsed())
+    static_assert(std::is_trivially_copyable_v<State>, "The states have to be trivially copyable to be saved");
+
+    Header header = {};
+    header.magic = Binary::magic;
+    header.version = Binary::version;
+    header.stateSize = sizeof(State);
+    header.states = this->states.size();
+    header.nodes = this->size();
+    header.directions = this->compiled ? this->compiled->directions : 0;
+    header.backtracks = this->backtracks;
+    header.compiled = this->compiled != nullptr;
+    header.counting = this->isCounting();
+    header.propagation = static_cast<uint8_t>(this->propagation);
+    header.heuristic = static_cast<uint8_t>(this->heuristic);
+    header.weightTables = this->weightTables.size();
+    header.masks = this->masks.size() / this->words;
+    Binary::write(stream, &header, 1);
+    Binary::write(stream, this->states.data(), this->states.size());
+
+    // The weights of every state in every table, states without a weight have the weight 1 or their weight from weights
+    std::vector<float> weights((this->weightTables.size() + 1) * this->states.size(), 1);
+    for (size_t t = 0; t <= this->weightTables.size(); t++)
+    {
+        for (size_t s = 0; s < this->states.size(); s++)
+        {
+            const std::map<State, float>& table = t == 0 ? this->weights : this->weightTables[t - 1];
+            auto it = table.find(this->states[s]);
+            weights[t * this->states.size() + s] = it != table.end() ? it->second : weights[s];
+        }
+    }
+
+    Binary::write(stream, weights.data(), weights.size());
+    if (!this->weightTables.empty())
+    {
+        std::vector<uint32_t> indices(this->size(), 0);
+        std::copy(this->weightIndices.begin(), this->weightIndices.end(), indices.begin());
+        Binary::write(stream, indices.data(), indices.size());
+    }
+
+    if (!this->masks.empty())
     {
-        Node<State>* node = this->getMinEntropy(randGen);
-        State state = this->getState(*node, randGen);
-        this->collapseNode(*node, state);
+        std::vector<uint32_t> indices(this->size(), 0);
+        std::copy(this->maskIndices.begin(), this->maskIndices.end(), indices.begin());
+        Binary::write(stream, this->masks.data(), this->masks.size());
+        Binary::write(stream, indices.data(), indices.size());
+    }
+
+    this->graph->save(stream);
+    Binary::write(stream, this->domains.data(), this->domains.size());
+    if (this->compiled)
+    {
+        size_t tableSize = this->compiled->directions * this->states.size() * this->words;
+        Binary::write(stream, this->compiled->rules, tableSize);
+        Binary::write(stream, this->compiled->transposed, tableSize);
+        Binary::write(stream, this->compiled->opposite, this->graph->getSlots());
+    }
+
+    if (this->isCounting())
+    {
+        Binary::write(stream, this->supports.data(), this->supports.size());
+    }
+
+    if (!stream)
+    {
+        throw std::runtime_error("Cannot write topology");
     }
 }
 
-template <class State>
-void Topology<State>::collapseNode(Node<State>& node, const State& state)
+template <class State, class GraphType, class Observer>
+Topology<State, GraphType, Observer> Topology<State, GraphType, Observer>::load(const Binary::Buffer& buffer, std::pmr::memory_resource* resource)
 {
-    auto it = std::find_if(node.states.begin(), node.states.end(), [&state](State& n) { return n == state; });
-    if (it == node.states.end())
+    static_assert(std::is_trivially_copyable_v<State>, "The states have to be trivially copyable to be loaded");
+
+    Binary::Reader reader(buffer);
+    const Header& header = *reader.read<Header>(1);
+    if (header.magic != Binary::magic || header.version != Binary::version || header.stateSize != sizeof(State) || header.propagation > 1 || header.heuristic > 1 ||
+        header.states == 0 || header.states >= UINT32_MAX || header.compiled > 1 || header.counting > header.compiled)
     {
-        throw std::logic_error("Invalid state to collapse");
+        throw std::runtime_error("Invalid binary data");
+    }
+
+    const State* states = reader.read<State>(header.states);
+    const float* weights = reader.read<float>((uint64_t(header.weightTables) + 1) * header.states);
+    const uint32_t* indices = header.weightTables != 0 ? reader.read<uint32_t>(header.nodes) : nullptr;
+    const uint64_t* masks = header.masks != 0 ? reader.read<uint64_t>(uint64_t(header.masks) * Bitset::getWords(header.states)) : nullptr;
+    const uint32_t* maskIndices = header.masks != 0 ? reader.read<uint32_t>(header.nodes) : nullptr;
+    GraphType graph = GraphType::load(reader);
+
+    // The support counters are only stored for a compiled topology without Propagation::Masks
+    bool counting = header.compiled && static_cast<Propagation>(header.propagation) != Propagation::Masks && graph.getSlots() != 0;
+    if (graph.size() != header.nodes || header.counting != counting)
+    {
+        throw std::runtime_error("Invalid binary data");
+    }
+
+    Topology topology(std::vector<State>(states, states + header.states), std::move(graph), resource);
+    for (size_t t = 0; t <= header.weightTables; t++)
+    {
+        std::map<State, float> table;
+        for (size_t s = 0; s < topology.states.size(); s++)
+        {
+            table[topology.states[s]] = weights[t * topology.states.size() + s];
+        }
+
+        if (t == 0)
+        {
+            topology.weights = std::move(table);
+        }
+        else
+        {
+            topology.addWeightTable(table);
+        }
+    }
+
+    if (indices)
+    {
+        topology.weightIndices.assign(indices, indices + topology.size());
+        if (std::any_of(indices, indices + topology.size(), [&header](uint32_t table) { return table > header.weightTables; }))
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+    }
+
+    // A bitset has no states after the state table, so every state it contains is in the table
+    auto isBitset = [&topology](const uint64_t* bits)
+    {
+        return topology.states.size() % 64 == 0 || bits[topology.words - 1] >> (topology.states.size() % 64) == 0;
+    };
+
+    if (masks)
+    {
+        topology.masks.assign(masks, masks + uint64_t(header.masks) * topology.words);
+        topology.maskIndices.assign(maskIndices, maskIndices + topology.size());
+        for (size_t m = 0; m < header.masks; m++)
+        {
+            if (!isBitset(&topology.masks[m * topology.words]) || Bitset::count(&topology.masks[m * topology.words], topology.words) == 0)
+            {
+                throw std::runtime_error("Invalid binary data");
+            }
+        }
+
+        if (std::any_of(maskIndices, maskIndices + topology.size(), [&header](uint32_t mask) { return mask > header.masks; }))
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+    }
+
+    topology.backtracks = header.backtracks;
+    topology.propagation = static_cast<Propagation>(header.propagation);
+    topology.heuristic = static_cast<Heuristic>(header.heuristic);
+
+    // Only the domains are copied, the heap is rebuilt from their sizes
+    const uint64_t* domains = reader.read<uint64_t>(topology.domains.size());
+    std::copy(domains, domains + topology.domains.size(), topology.domains.begin());
+    for (size_t i = 0; i < topology.size(); i++)
+    {
+        size_t size = Bitset::count(topology.getDomain(i), topology.words);
+        if (size == 0 || !isBitset(topology.getDomain(i)))
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+
+        topology.setSize(i, size);
+    }
+
+    if (header.compiled)
+    {
+        // compile() has as many directions as the largest degree, and the opposite slot of a slot points back to its node
+        size_t directions = 0;
+        for (size_t i = 0; i < topology.size(); i++)
+        {
+            directions = std::max(directions, topology.graph->getDegree(i));
+        }
+
+        if (header.directions != directions)
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
+
+        auto c = std::make_shared<Compiled>();
+        size_t tableSize = directions * topology.states.size() * topology.words;
+        c->directions = directions;
+        c->rules = reader.read<uint64_t>(tableSize);
+        c->transposed = reader.read<uint64_t>(tableSize);
+        c->opposite = reader.read<uint32_t>(topology.graph->getSlots());
+        c->data = buffer.data;
+        for (size_t i = 0; i < topology.size(); i++)
+        {
+            for (size_t d = 0; d < topology.graph->getDegree(i); d++)
+            {
+                uint32_t b = topology.graph->getAdjacent(i, d);
+                uint32_t r = c->opposite[topology.graph->getSlot(i) + d];
+                if (b != GraphType::none && (r >= topology.graph->getDegree(b) || topology.graph->getAdjacent(b, r) != i))
+                {
+                    throw std::runtime_error("Invalid binary data");
+                }
+            }
+        }
+
+        for (size_t row = 0; row < directions * topology.states.size(); row++)
+        {
+            if (!isBitset(&c->rules[row * topology.words]) || !isBitset(&c->transposed[row * topology.words]))
+            {
+                throw std::runtime_error("Invalid binary data");
+            }
+        }
+
+        topology.compiled = std::move(c);
+    }
+
+    if (header.counting)
+    {
+        const uint32_t* supports = reader.read<uint32_t>(topology.graph->getSlots() * topology.states.size());
+        topology.supports.assign(supports, supports + topology.graph->getSlots() * topology.states.size());
+        if (std::any_of(supports, supports + topology.supports.size(), [&topology](uint32_t support) { return support > topology.states.size(); }))
+        {
+            throw std::runtime_error("Invalid binary data");
+        }
     }
 
-    node.states = { *it };
-    this->propagate(node);
+    return topology;
 }
 
-template <class State>
-bool Topology<State>::isCorrect() const
+template <class State, class GraphType, class Observer>
+uint64_t* Topology<State, GraphType, Observer>::getDomain(size_t node)
 {
-    return std::all_of(
-        this->nodes.begin(),
-        this->nodes.end(),
-        [this](const Node<State>& a)
-        {
-            return a.states.size() == 1 &&
-                std::all_of(
-                    a.adjacent.begin(),
-                    a.adjacent.end(),
-                    [this, &a](const Node<State>* b)
-                    {
-                        return b == nullptr || b->states.size() == 1 && this->compatible(a, a.states.at(0), *b, b->states.at(0));
-                    });
-        });
+    return &this->domains[node * this->words];
+}
+
+template <class State, class GraphType, class Observer>
+const uint64_t* Topology<State, GraphType, Observer>::getDomain(size_t node) const
+{
+    return &this->domains[node * this->words];
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::getStateIndex(const State& state) const
+{
+    return std::find(this->states.begin(), this->states.end(), state) - this->states.begin();
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::isCollapsed() const
+{
+    return this->heap.empty();
+}
+
+template <class State, class GraphType, class Observer>
+size_t Topology<State, GraphType, Observer>::getMinEntropy() const
+{
+    return this->heap.top();
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::setSize(size_t node, size_t size)
+{
+    this->sizes[node] = size;
+    if (size > 1)
+    {
+        this->heap.update(node, this->getEntropy(node));
+    }
+    else
+    {
+        this->heap.remove(node);
+    }
 }
 
-template <class State>
-bool Topology<State>::isCollapsed() const
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::propagate(size_t node)
 {
-    return std::all_of(this->nodes.begin(), this->nodes.end(), [](const Node<State>& node) { return node.states.size() == 1; });
+    return this->propagate(&node, 1);
 }
 
-template <class State>
-Node<State>* Topology<State>::getMinEntropy(std::mt19937& randGen)
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::propagate(const size_t* nodes, size_t count)
 {
-    size_t minEntropy = -1;
-    for (size_t i = 0; i < this->nodes.size(); i++)
+    this->observer.onBegin(Phase::Propagation);
+    bool valid;
+    size_t visited = 0;
+    if (this->isCounting())
     {
-        size_t entropy = this->nodes[i].states.size();
-        if (entropy < minEntropy && entropy != 1)
+        size_t begin = this->propagated;
+        valid = this->propagateCompiled();
+        visited = this->propagated - begin;
+    }
+    else
+    {
+        valid = this->propagateWorklist(nodes, count, visited);
+    }
+
+    this->observer.onWave(visited);
+    this->observer.onEnd(Phase::Propagation);
+    return valid;
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::propagateWorklist(const size_t* nodes, size_t size, size_t& visited)
+{
+    this->nextEpoch();
+
+    // Every node is at most once in the worklist, a node is added again if it changes after it was processed
+    size_t head = 0, count = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (this->marks[nodes[i]] != this->epoch)
+        {
+            this->worklist[count++] = nodes[i];
+            this->marks[nodes[i]] = this->epoch;
+        }
+    }
+
+    while (count != 0)
+    {
+        size_t current = this->worklist[head];
+        head = (head + 1) % this->worklist.size();
+        count--;
+        visited++;
+        this->marks[current] = 0;
+
+        for (size_t d = 0; d < this->graph->getDegree(current); d++)
         {
-            minEntropy = entropy;
+            size_t index = this->graph->getAdjacent(current, d);
+            if (index == GraphType::none)
+            {
+                continue;
+            }
+
+            bool changed;
+            if (!(this->compiled ? this->reduceMasks(current, d, index, changed) : this->reduceStates(index, changed)))
+            {
+                return false;
+            }
+
+            if (changed && this->marks[index] != this->epoch)
+            {
+                this->worklist[(head + count) % this->worklist.size()] = index;
+                this->marks[index] = this->epoch;
+                count++;
+            }
         }
     }
 
-    std::vector<Node<State>*> minNodes;
-    for (Node<State>& node : this->nodes)
+    return true;
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::reduceStates(size_t a, bool& changed)
+{
+    bool valid = true;
+    changed = false;
+    if (this->compiled)
     {
-        if (node.states.size() == minEntropy)
+        // Reduce the node by each adjacent node, in the direction from the adjacent node back to the node
+        for (size_t d = 0; d < this->graph->getDegree(a) && valid; d++)
         {
-            minNodes.push_back(&node);
+            uint32_t b = this->graph->getAdjacent(a, d);
+            if (b != GraphType::none)
+            {
+                bool reduced;
+                valid = this->reduceMasks(b, this->compiled->opposite[this->graph->getSlot(a) + d], a, reduced);
+                changed = changed || reduced;
+            }
         }
+
+        return valid;
+    }
+
+    this->observer.onReduce(a);
+    Bitset::forEach(
+        this->getDomain(a),
+        this->words,
+        [this, a, &valid, &changed](size_t aState)
+        {
+            if (valid && !this->isPlaceable(a, aState))
+            {
+                valid = this->erase(a, aState);
+                changed = true;
+            }
+        });
+
+    if (changed)
+    {
+        this->setSize(a, this->sizes[a]);
     }
 
-    return minNodes[randGen() % minNodes.size()];
+    return valid;
 }
 
-template <class State>
-void Topology<State>::propagate(Node<State>& node)
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::reduceMasks(size_t a, size_t direction, size_t b, bool& changed)
 {
-    std::queue<Node<State>*> queue({ &node });
-    std::vector<Node<State>*> visited({ &node });
-    visited.reserve(this->nodes.size());
-    while (!queue.empty())
+    changed = false;
+    this->observer.onReduce(b);
+    switch (this->intersectMasks(a, direction, b, this->allowed.data(), this->removed.data()))
     {
-        Node<State>* current = queue.front();
-        queue.pop();
+    case Kernels::Intersection::Unchanged:
+        return true;
+    case Kernels::Intersection::Empty:
+        this->conflict = b;
+        return false;
+    default:
+        break;
+    }
+
+    Bitset::forEach(this->removed.data(), this->words, [this, b](size_t s) { this->erase(b, s); });
+    this->setSize(b, this->sizes[b]);
+    changed = true;
+    return true;
+}
 
-        for (Node<State>* neighbour : current->adjacent)
+template <class State, class GraphType, class Observer>
+Kernels::Intersection Topology<State, GraphType, Observer>::intersectMasks(size_t a, size_t direction, size_t b, uint64_t* allowed, uint64_t* removed) const
+{
+    const Compiled& c = *this->compiled;
+    const Kernels::Functions& kernels = Kernels::get();
+    size_t rowSize = this->states.size() * this->words;
+    const uint64_t* rows = &c.rules[direction * rowSize];
+    const uint64_t* domain = this->getDomain(b);
+
+    // Union of the states of b compatible with a state of a, stopping early once it contains the domain of b
+    std::fill(allowed, allowed + this->words, 0);
+    const uint64_t* aDomain = this->getDomain(a);
+    size_t united = 0;
+    for (size_t w = 0; w < this->words; w++)
+    {
+        for (uint64_t word = aDomain[w]; word != 0; word &= word - 1)
         {
-            if (neighbour != nullptr &&
-                std::find(visited.begin(), visited.end(), neighbour) == visited.end() &&
-                this->reduceStates(*neighbour))
+            kernels.unite(allowed, rows + (w * 64 + Bitset::lowest(word)) * this->words, this->words);
+            if (++united % 8 == 0 && kernels.covers(allowed, domain, this->words))
             {
-                queue.push(neighbour);
-                visited.push_back(neighbour);
+                return Kernels::Intersection::Unchanged;
             }
         }
     }
+
+    return kernels.intersect(removed, domain, allowed, this->words);
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::isCounting() const
+{
+    return this->compiled && !this->supports.empty();
+}
+
+template <class State, class GraphType, class Observer>
+template <class Engine>
+size_t Topology<State, GraphType, Observer>::getState(size_t a, Engine& randGen)
+{
+    // The domains of a compiled topology only contain placeable states, otherwise they are only reduced around collapsed nodes
+    size_t state = Topology::sampleState(
+        this->getDomain(a),
+        this->words,
+        &this->stateWeights[this->getWeightRow(a)],
+        randGen,
+        this->candidates,
+        this->cumulativeWeights,
+        [this, a](size_t aState) { return this->compiled || this->isPlaceable(a, aState); });
+
+    return state == Result::none ? this->states.size() : state;
 }
 
-template <class State>
-bool Topology<State>::reduceStates(Node<State>& a)
+template <class State, class GraphType, class Observer>
+template <class Engine, class Filter>
+size_t Topology<State, GraphType, Observer>::sampleState(
+    const uint64_t* domain,
+    size_t words,
+    const double* weights,
+    Engine& randGen,
+    std::pmr::vector<size_t>& candidates,
+    std::pmr::vector<double>& cumulativeWeights,
+    const Filter& filter)
 {
-    std::vector<State> newStates;
-    std::copy_if(
-        a.states.begin(),
-        a.states.end(),
-        std::back_inserter(newStates),
-        [this, &a](const State& aState) { return this->isPlaceable(a, aState); });
+    candidates.clear();
+    cumulativeWeights.clear();
+    double sum = 0;
+    Bitset::forEach(
+        domain,
+        words,
+        [weights, &filter, &candidates, &cumulativeWeights, &sum](size_t state)
+        {
+            if (weights[state] > 0 && filter(state))
+            {
+                sum += weights[state];
+                candidates.push_back(state);
+                cumulativeWeights.push_back(sum);
+            }
+        });
 
-    bool changed = newStates.size() != a.states.size();
-    a.states = newStates;
-    if (newStates.empty())
+    if (candidates.size() == 0)
     {
-        throw std::runtime_error("No valid states");
+        return Result::none;
     }
 
-    return changed;
+    // Select the first candidate whose cumulative weight exceeds a random value in [0, sum)
+    size_t i = std::upper_bound(cumulativeWeights.begin(), cumulativeWeights.end(), Random::canonical(randGen) * sum) - cumulativeWeights.begin();
+    return candidates[std::min(i, candidates.size() - 1)];
 }
 
-template <class State>
-State Topology<State>::getState(const Node<State>& a, std::mt19937& randGen) const
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::isPlaceable(size_t a, size_t aState, size_t* calls) const
 {
-    std::vector<State> aStates;
-    std::vector<double> aWeights;
-    for (const State& aState : a.states)
+    for (size_t d = 0; d < this->graph->getDegree(a); d++)
     {
-        float aWeight = this->weights.find(aState) != this->weights.end() ? this->weights.at(aState) : 1;
-        if (aWeight > 0 && this->isPlaceable(a, aState))
+        uint32_t b = this->graph->getAdjacent(a, d);
+        if (b == GraphType::none)
+        {
+            continue;
+        }
+
+        bool supported = false;
+        const uint64_t* domain = this->getDomain(b);
+        for (size_t w = 0; w < this->words && !supported; w++)
+        {
+            for (uint64_t word = domain[w]; word != 0 && !supported; word &= word - 1)
+            {
+                supported = this->isCompatible(a, aState, d, b, w * 64 + Bitset::lowest(word), calls);
+            }
+        }
+
+        if (!supported)
         {
-            aStates.push_back(aState);
-            aWeights.push_back(aWeight);
+            return false;
         }
     }
 
-    if (aStates.size() == 0)
+    return true;
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::isCompatible(size_t a, size_t aState, size_t direction, size_t b, size_t bState, size_t* calls) const
+{
+    // The evaluations on worker threads are counted and passed to the observer later
+    if (calls)
     {
-        throw std::runtime_error("No valid states");
+        (*calls)++;
+    }
+    else
+    {
+        this->observer.onCompatible();
+    }
+
+    if (this->compatibleStates)
+    {
+        return this->compatibleStates(aState, direction, bState);
+    }
+
+    return this->compatible(a, this->states[aState], direction, b, this->states[bState]);
+}
+
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::isPairCorrect(size_t a, size_t aState, size_t direction, size_t b, size_t bState) const
+{
+    // A compiled topology checks its tables, so a loaded topology does not need the compatible function
+    if (this->compiled)
+    {
+        return Bitset::test(&this->compiled->rules[(direction * this->states.size() + aState) * this->words], bState);
     }
 
-    std::discrete_distribution<size_t> randState(aWeights.begin(), aWeights.end());
-    return aStates[randState(randGen)];
+    return this->isCompatible(a, aState, direction, b, bState);
 }
 
-template <class State>
-bool Topology<State>::isPlaceable(const Node<State>& node, const State& state) const
+template <class State, class GraphType, class Observer>
+bool Topology<State, GraphType, Observer>::propagateCompiled()
 {
-    return std::all_of(
-        node.adjacent.begin(),
-        node.adjacent.end(),
-        [this, &node, &state](const Node<State>* adjacent)
+    const Compiled& c = *this->compiled;
+    size_t rowSize = this->states.size() * this->words;
+    bool valid = true;
+    while (valid && this->propagated < this->trail.size())
+    {
+        // Every removal is subtracted from all support counters even if a contradiction is found, so it can be undone
+        auto [b, sb] = this->trail[this->propagated++];
+        for (size_t r = 0; r < this->graph->getDegree(b); r++)
         {
-            return adjacent == nullptr ||
-                std::any_of(
-                    adjacent->states.begin(),
-                    adjacent->states.end(),
-                    [this, &node, adjacent, &state](const State& adjacentState)
+            size_t a = this->graph->getAdjacent(b, r);
+            if (a == GraphType::none)
+            {
+                continue;
+            }
+
+            // The states of a that lose a support in direction d (towards b)
+            size_t d = c.opposite[this->graph->getSlot(b) + r];
+            uint32_t* supports = &this->supports[(this->graph->getSlot(a) + d) * this->states.size()];
+            const uint64_t* domain = this->getDomain(a);
+            Bitset::forEach(
+                &c.transposed[d * rowSize + sb * this->words],
+                this->words,
+                [this, a, supports, domain, &valid](size_t sa)
+                {
+                    if (--supports[sa] == 0 && valid && Bitset::test(domain, sa))
                     {
-                        return this->compatible(node, state, *adjacent, adjacentState);
-                    });
-        });
+                        valid = this->ban(a, sa);
+                    }
+                });
+        }
+    }
+
+    return valid;
+}
+
+template <class State, class GraphType, class Observer>
+void Topology<State, GraphType, Observer>::updateSupports(size_t b, size_t bState, int delta)
+{
+    const Compiled& c = *this->compiled;
+    size_t rowSize = this->states.size() * this->words;
+    for (size_t r = 0; r < this->graph->getDegree(b); r++)
+    {
+        size_t a = this->graph->getAdjacent(b, r);
+        if (a == GraphType::none)
+        {
+            continue;
+        }
+
+        size_t d = c.opposite[this->graph->getSlot(b) + r];
+        uint32_t* supports = &this->supports[(this->graph->getSlot(a) + d) * this->states.size()];
+        Bitset::forEach(&c.transposed[d * rowSize + bState * this->words], this->words, [supports, delta](size_t sa) { supports[sa] += delta; });
+    }
 }
 
 }
@@ -0,0 +1,178 @@
+/**
+ * @file Workers.h
+ * @brief Workers class for running the passes of data-parallel algorithms on threads started once.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+namespace WFC
+{
+
+/**
+ * @brief Workers class for running the passes of data-parallel algorithms on threads started once.
+ *
+ * The threads are started by the constructor and wait for the next pass, so an algorithm with thousands of passes
+ * does not start a thread per pass. Each pass splits a range of items into one range per thread, the calling thread
+ * processes the first range and waits until the other threads have processed theirs.
+ */
+class Workers
+{
+public:
+    /**
+     * @brief Start the threads.
+     * @param threads The number of threads, including the calling thread.
+     */
+    explicit Workers(size_t threads) : count(std::max<size_t>(threads, 1))
+    {
+        this->threads.reserve(this->count - 1);
+        for (size_t t = 1; t < this->count; t++)
+        {
+            this->threads.emplace_back([this, t]() { this->work(t); });
+        }
+    }
+
+    Workers(const Workers&) = delete;
+    Workers& operator=(const Workers&) = delete;
+
+    /**
+     * @brief Stop the threads once they finished their pass.
+     */
+    ~Workers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+        }
+
+        this->started.notify_all();
+        for (std::thread& thread : this->threads)
+        {
+            thread.join();
+        }
+    }
+
+    /**
+     * @brief Get the number of threads, including the calling thread.
+     * @return The number of threads.
+     */
+    size_t size() const
+    {
+        return this->count;
+    }
+
+    /**
+     * @brief Run a function on ranges of items on the threads and wait until all ranges are processed.
+     *
+     * Every thread processes at least grain items, so small passes run on fewer threads or on the calling thread only.
+     *
+     * @param items The number of items.
+     * @param grain The minimum number of items of a thread.
+     * @param function The function called with the range of items [begin, end) and the index of the thread.
+     * @throw Rethrows the first exception thrown by the function, once all ranges are processed.
+     */
+    void forEach(size_t items, size_t grain, const std::function<void(size_t begin, size_t end, size_t thread)>& function)
+    {
+        size_t used = std::min(this->count, std::max<size_t>(items / std::max<size_t>(grain, 1), 1));
+        if (used == 1)
+        {
+            function(0, items, 0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->function = &function;
+            this->items = items;
+            this->used = used;
+            this->running = used - 1;
+            this->error = nullptr;
+            this->generation++;
+        }
+
+        this->started.notify_all();
+        std::exception_ptr error;
+        try
+        {
+            function(0, items / used, 0);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->finished.wait(lock, [this]() { return this->running == 0; });
+        error = error ? error : this->error;
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+private:
+    // Number of threads including the calling thread, and the started threads
+    size_t count;
+    std::vector<std::thread> threads;
+
+    // The pass the threads run, each pass increments the generation
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    const std::function<void(size_t, size_t, size_t)>* function = nullptr;
+    size_t items = 0;
+    size_t used = 0;
+    size_t running = 0;
+    size_t generation = 0;
+    bool stopping = false;
+
+    // First exception of a thread in the current pass
+    std::exception_ptr error;
+
+    void work(size_t thread)
+    {
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(this->mutex);
+        while (true)
+        {
+            this->started.wait(lock, [this, seen]() { return this->stopping || this->generation != seen; });
+            if (this->stopping)
+            {
+                return;
+            }
+
+            seen = this->generation;
+            if (thread >= this->used)
+            {
+                continue;
+            }
+
+            const std::function<void(size_t, size_t, size_t)>& function = *this->function;
+            size_t begin = this->items * thread / this->used, end = this->items * (thread + 1) / this->used;
+            lock.unlock();
+            try
+            {
+                function(begin, end, thread);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(this->mutex);
+                this->error = this->error ? this->error : std::current_exception();
+            }
+
+            lock.lock();
+            if (--this->running == 0)
+            {
+                this->finished.notify_one();
+            }
+        }
+    }
+};
+
+}
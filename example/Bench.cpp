@@ -0,0 +1,511 @@
+#include "Sudoku.h"
+#include "Random.h"
+#include "CartesianTopology.h"
+
+#include <map>
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <numeric>
+#include <iostream>
+#include <stdexcept>
+#include <functional>
+
+namespace
+{
+
+/**
+ * @brief Measures the iterations of a benchmark, only the time between start() and stop() is counted.
+ */
+class Timer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief The index of the current iteration, used as seed.
+     */
+    size_t iteration = 0;
+
+    /**
+     * @brief Set by the benchmark when the iteration ends with a contradiction.
+     */
+    bool contradiction = false;
+
+    void start()
+    {
+        this->begin = Clock::now();
+    }
+
+    void stop()
+    {
+        this->elapsed += Clock::now() - this->begin;
+    }
+
+    double getSeconds() const
+    {
+        return std::chrono::duration<double>(this->elapsed).count();
+    }
+private:
+    Clock::time_point begin;
+    Clock::duration elapsed = Clock::duration::zero();
+};
+
+/**
+ * @brief A benchmark creates its topology only when it runs, so the memory of one benchmark is released before the next one.
+ */
+struct Benchmark
+{
+    std::string name;
+    size_t nodes;
+    std::function<std::function<void(Timer&)>()> create;
+};
+
+enum class Mode
+{
+    Plain,
+    Supports,
+    Masks,
+};
+
+const std::array<Mode, 3> modes = { Mode::Plain, Mode::Supports, Mode::Masks };
+
+std::string getName(Mode mode)
+{
+    return mode == Mode::Plain ? "plain" : mode == Mode::Supports ? "supports" : "masks";
+}
+
+/**
+ * @brief The support counters use 4 bytes per slot and state, which is too much for the largest topologies.
+ */
+bool isSupported(Mode mode, size_t nodes, size_t slots)
+{
+    return mode != Mode::Supports || nodes * slots <= (1 << 20) * 64;
+}
+
+template <class Topology>
+void prepare(Topology& topology, Mode mode)
+{
+    if (mode != Mode::Plain)
+    {
+        topology.propagation = mode == Mode::Supports ? WFC::Propagation::Supports : WFC::Propagation::Masks;
+        topology.compile();
+    }
+}
+
+template <size_t Dim>
+std::string getName(const WFC::CartesianTopology::Vec<Dim>& size)
+{
+    std::string name;
+    for (size_t k = 0; k < Dim; k++)
+    {
+        name += (k == 0 ? "" : "x") + std::to_string(size[k]);
+    }
+
+    return name;
+}
+
+std::map<char, std::array<bool, 4>> getPipes()
+{
+    // The tokens of the pipes example
+    return {
+        { char(' '), { 0, 0, 0, 0 } }, { char(179), { 0, 0, 1, 1 } }, { char(180), { 1, 0, 1, 1 } }, { char(191), { 1, 0, 0, 1 } },
+        { char(192), { 0, 1, 1, 0 } }, { char(193), { 1, 1, 1, 0 } }, { char(194), { 1, 1, 0, 1 } }, { char(195), { 0, 1, 1, 1 } },
+        { char(196), { 1, 1, 0, 0 } }, { char(197), { 1, 1, 1, 1 } }, { char(217), { 1, 0, 1, 0 } }, { char(218), { 0, 1, 0, 1 } },
+    };
+}
+
+/**
+ * @brief Every combination of connections in 3D, so the tileset never contradicts.
+ */
+std::map<uint8_t, std::array<bool, 6>> getPipes3D()
+{
+    std::map<uint8_t, std::array<bool, 6>> tokens;
+    for (uint8_t s = 0; s < 64; s++)
+    {
+        for (size_t d = 0; d < 6; d++)
+        {
+            tokens[s][d] = s >> d & 1;
+        }
+    }
+
+    return tokens;
+}
+
+/**
+ * @brief A tileset with a specific number of states and pseudo-random binary tokens.
+ */
+std::map<uint32_t, std::array<bool, 4>> getSynthetic(size_t count)
+{
+    std::map<uint32_t, std::array<bool, 4>> tokens;
+    for (uint32_t s = 0; s < count; s++)
+    {
+        for (size_t d = 0; d < 4; d++)
+        {
+            tokens[s][d] = WFC::Random::mix(s * 4 + d) & 1;
+        }
+    }
+
+    return tokens;
+}
+
+/**
+ * @brief Measure the creation of a topology.
+ */
+template <class Create>
+std::function<void(Timer&)> benchCreate(Create create)
+{
+    return [create](Timer& timer)
+    {
+        timer.start();
+        auto topology = create();
+        timer.stop();
+    };
+}
+
+/**
+ * @brief Collapse copies of a topology, the copy is not measured.
+ */
+template <class Topology>
+std::function<void(Timer&)> benchCollapse(Topology prototype)
+{
+    return [prototype](Timer& timer)
+    {
+        Topology topology = prototype;
+        timer.start();
+        try
+        {
+            topology.collapse(static_cast<unsigned int>(timer.iteration));
+        }
+        catch (const std::runtime_error&)
+        {
+            timer.contradiction = true;
+        }
+
+        timer.stop();
+    };
+}
+
+/**
+ * @brief Collapse copies of a topology with batches of 64 nodes and waves within 4 steps on a number of threads, the copy is not measured.
+ */
+template <class Topology>
+std::function<void(Timer&)> benchBatched(Topology prototype, size_t threads)
+{
+    return [prototype, threads](Timer& timer)
+    {
+        Topology topology = prototype;
+        timer.start();
+        try
+        {
+            topology.collapseBatched(64, 4, static_cast<unsigned int>(timer.iteration), threads);
+        }
+        catch (const std::runtime_error&)
+        {
+            timer.contradiction = true;
+        }
+
+        timer.stop();
+    };
+}
+
+/**
+ * @brief Collapse the nodes of copies of a topology in order with their first state, which measures the propagation without the selection.
+ */
+template <class Topology>
+std::function<void(Timer&)> benchPropagate(Topology prototype)
+{
+    return [prototype](Timer& timer)
+    {
+        Topology topology = prototype;
+        timer.start();
+        try
+        {
+            for (size_t i = 0; i < topology.size(); i++)
+            {
+                if (topology.getStates(i).size() > 1)
+                {
+                    topology.collapseNode(i, topology.getStates(i)[0]);
+                }
+            }
+        }
+        catch (const std::runtime_error&)
+        {
+            timer.contradiction = true;
+        }
+
+        timer.stop();
+    };
+}
+
+std::vector<Benchmark> getBenchmarks()
+{
+    std::vector<Benchmark> benchmarks;
+    for (size_t n : { 64, 256, 1024, 2048 })
+    {
+        WFC::CartesianTopology::Vec<2> size = { n, n };
+        std::string grid = getName<2>(size);
+        auto create = [size]() { return WFC::CartesianTopology::createCartTokens<2, char, bool>(size, getPipes(), { true, true }); };
+        benchmarks.push_back({ "createCartTokens/pipes/" + grid, n * n, [create]() { return benchCreate(create); } });
+
+        for (Mode mode : modes)
+        {
+            if ((mode == Mode::Plain && n > 1024) || !isSupported(mode, n * n, 4 * 12))
+            {
+                continue;
+            }
+
+            std::string name = "pipes/" + grid + "/" + getName(mode);
+            if (mode != Mode::Plain)
+            {
+                benchmarks.push_back({ "compile/" + name, n * n, [create, mode]()
+                    {
+                        return [topology = create(), mode](Timer& timer)
+                        {
+                            WFC::CartesianGrid<2, char> copy = topology;
+                            timer.start();
+                            prepare(copy, mode);
+                            timer.stop();
+                        };
+                    } });
+            }
+
+            auto prepared = [create, mode]()
+            {
+                WFC::CartesianGrid<2, char> topology = create();
+                prepare(topology, mode);
+                return topology;
+            };
+
+            benchmarks.push_back({ "propagate/" + name, n * n, [prepared]() { return benchPropagate(prepared()); } });
+            benchmarks.push_back({ "collapse/" + name, n * n, [prepared]() { return benchCollapse(prepared()); } });
+        }
+    }
+
+    // The same grids as the collapse benchmarks, so the batched collapse on one thread shows its overhead and more threads its speedup
+    for (size_t n : { 256, 1024 })
+    {
+        WFC::CartesianTopology::Vec<2> size = { n, n };
+        for (Mode mode : modes)
+        {
+            if ((mode == Mode::Plain && n > 256) || !isSupported(mode, n * n, 4 * 12))
+            {
+                continue;
+            }
+
+            for (size_t threads : { 1, 2, 4, 8 })
+            {
+                std::string name = "batched/pipes/" + getName<2>(size) + "/" + getName(mode) + "/" + std::to_string(threads);
+                benchmarks.push_back({ name, n * n, [size, mode, threads]()
+                    {
+                        WFC::CartesianGrid<2, char> topology = WFC::CartesianTopology::createCartTokens<2, char, bool>(size, getPipes(), { true, true });
+                        prepare(topology, mode);
+                        return benchBatched(topology, threads);
+                    } });
+            }
+        }
+    }
+
+    for (Mode mode : modes)
+    {
+        benchmarks.push_back({ "collapse/sudoku/" + getName(mode), 81, [mode]()
+            {
+                WFC::Topology<int> topology = Sudoku::create();
+                topology.backtracks = 1000;
+                prepare(topology, mode);
+                return benchCollapse(topology);
+            } });
+    }
+
+    for (size_t n : { 16, 32, 64 })
+    {
+        WFC::CartesianTopology::Vec<3> size = { n, n, n };
+        benchmarks.push_back({ "createCartTokens/pipes3d/" + getName<3>(size), n * n * n, [size]()
+            {
+                return benchCreate([size]() { return WFC::CartesianTopology::createCartTokens<3, uint8_t, bool>(size, getPipes3D(), { true, true, true }); });
+            } });
+
+        for (Mode mode : modes)
+        {
+            if (!isSupported(mode, n * n * n, 6 * 64))
+            {
+                continue;
+            }
+
+            benchmarks.push_back({ "collapse/pipes3d/" + getName<3>(size) + "/" + getName(mode), n * n * n, [size, mode]()
+                {
+                    WFC::CartesianGrid<3, uint8_t> topology = WFC::CartesianTopology::createCartTokens<3, uint8_t, bool>(size, getPipes3D(), { true, true, true });
+                    prepare(topology, mode);
+                    return benchCollapse(topology);
+                } });
+        }
+    }
+
+    for (size_t count : { 4, 16, 64, 256, 1000, 2000 })
+    {
+        WFC::CartesianTopology::Vec<2> size = { 64, 64 };
+        benchmarks.push_back({ "createCartTokens/synthetic/" + std::to_string(count) + "/" + getName<2>(size), 64 * 64, [size, count]()
+            {
+                return benchCreate([size, count]() { return WFC::CartesianTopology::createCartTokens<2, uint32_t, bool>(size, getSynthetic(count), { true, true }); });
+            } });
+
+        for (Mode mode : modes)
+        {
+            if (mode == Mode::Plain && count > 64)
+            {
+                continue;
+            }
+
+            std::string name = "synthetic/" + std::to_string(count) + "/" + getName<2>(size) + "/" + getName(mode);
+            auto create = [size, count]() { return WFC::CartesianTopology::createCartTokens<2, uint32_t, bool>(size, getSynthetic(count), { true, true }); };
+            if (mode != Mode::Plain)
+            {
+                benchmarks.push_back({ "compile/" + name, 64 * 64, [create, mode]()
+                    {
+                        return [topology = create(), mode](Timer& timer)
+                        {
+                            WFC::CartesianGrid<2, uint32_t> copy = topology;
+                            timer.start();
+                            try
+                            {
+                                prepare(copy, mode);
+                            }
+                            catch (const std::runtime_error&)
+                            {
+                                timer.contradiction = true;
+                            }
+
+                            timer.stop();
+                        };
+                    } });
+            }
+
+            // A compile that contradicts leaves nothing to collapse, every iteration counts as a contradiction
+            benchmarks.push_back({ "collapse/" + name, 64 * 64, [create, mode]() -> std::function<void(Timer&)>
+                {
+                    WFC::CartesianGrid<2, uint32_t> topology = create();
+                    try
+                    {
+                        prepare(topology, mode);
+                    }
+                    catch (const std::runtime_error&)
+                    {
+                        return [](Timer& timer) { timer.contradiction = true; };
+                    }
+
+                    return benchCollapse(topology);
+                } });
+
+            // Large tilesets spend most of the collapse in the waves, which collapseBatched propagates concurrently
+            for (size_t threads : { 1, 2, 4, 8 })
+            {
+                if (mode != Mode::Masks || count < 256)
+                {
+                    continue;
+                }
+
+                benchmarks.push_back({ "batched/" + name + "/" + std::to_string(threads), 64 * 64, [create, mode, threads]() -> std::function<void(Timer&)>
+                    {
+                        WFC::CartesianGrid<2, uint32_t> topology = create();
+                        try
+                        {
+                            prepare(topology, mode);
+                        }
+                        catch (const std::runtime_error&)
+                        {
+                            return [](Timer& timer) { timer.contradiction = true; };
+                        }
+
+                        return benchBatched(topology, threads);
+                    } });
+            }
+        }
+    }
+
+    // The nodes have no adjacent nodes, so the propagation ends at once and a collapse measures the selection of the nodes and the sampling of their states
+    for (size_t count : { 16, 256 })
+    {
+        for (WFC::Heuristic heuristic : { WFC::Heuristic::Count, WFC::Heuristic::Entropy })
+        {
+            std::string name = std::string(heuristic == WFC::Heuristic::Count ? "count" : "entropy") + "/" + std::to_string(count) + "/65536";
+            benchmarks.push_back({ "select/" + name, 65536, [count, heuristic]()
+                {
+                    std::vector<uint32_t> states(count);
+                    std::iota(states.begin(), states.end(), 0);
+                    WFC::Topology<uint32_t> topology(states, WFC::Graph(65536, 0));
+                    topology.heuristic = heuristic;
+                    for (uint32_t s = 0; s < count; s++)
+                    {
+                        topology.weights[s] = 1 + s % 7;
+                    }
+
+                    return benchCollapse(topology);
+                } });
+        }
+    }
+
+    return benchmarks;
+}
+
+}
+
+/**
+ * Usage: wfc_bench [--filter=<substring>] [--min-time=<seconds>]
+ *
+ * Every benchmark whose name contains the filter is repeated until the measured time reaches the minimum time.
+ * The time is reported per node of the topology, contradictions are the fraction of iterations that failed.
+ */
+int main(int argc, char** argv)
+{
+    std::string filter;
+    double minTime = 0.5;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--filter=", 0) == 0)
+        {
+            filter = arg.substr(9);
+        }
+        else if (arg.rfind("--min-time=", 0) == 0)
+        {
+            minTime = std::atof(arg.c_str() + 11);
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--filter=<substring>] [--min-time=<seconds>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << std::left << std::setw(48) << "Benchmark" << std::right << std::setw(16) << "Time/node" << std::setw(12) << "Iterations" << std::setw(16) << "Contradictions" << std::endl;
+    std::cout << std::string(92, '-') << std::endl;
+    for (const Benchmark& benchmark : getBenchmarks())
+    {
+        if (benchmark.name.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+
+        std::function<void(Timer&)> run = benchmark.create();
+        Timer timer;
+        size_t contradictions = 0;
+        for (; timer.iteration == 0 || (timer.getSeconds() < minTime && timer.iteration < 10000); timer.iteration++)
+        {
+            timer.contradiction = false;
+            run(timer);
+            contradictions += timer.contradiction;
+        }
+
+        double nsPerNode = timer.getSeconds() * 1e9 / (timer.iteration * benchmark.nodes);
+        std::cout << std::left << std::setw(48) << benchmark.name << std::right << std::fixed
+                  << std::setw(13) << std::setprecision(1) << nsPerNode << " ns"
+                  << std::setw(12) << timer.iteration
+                  << std::setw(15) << std::setprecision(1) << 100.0 * contradictions / timer.iteration << "%" << std::endl;
+    }
+
+    return 0;
+}
@@ -4,7 +4,7 @@
 #include <vector>
 #include <iostream>
 
-WFC::Topology<char> Pipes::create(size_t w, size_t h)
+WFC::CartesianGrid<2, char> Pipes::create(size_t w, size_t h, const std::array<bool, 2>& periods)
 {
     const std::map<char, std::array<bool, 4>> tokens
     {
@@ -23,26 +23,41 @@ WFC::Topology<char> Pipes::create(size_t w, size_t h)
         { char(218), { 0, 1, 0, 1 } }, // ┌
     };
 
-    return WFC::CartesianTopology::createCartTokens<2, char, bool>({w, h}, tokens, { true, true });
+    WFC::CartesianGrid<2, char> topology = WFC::CartesianTopology::createCartTokens<2, char, bool>({w, h}, tokens, periods);
+    topology.compile();
+    return topology;
 }
 
-void Pipes::print(const WFC::Topology<char>& topology, size_t w, size_t h)
+void Pipes::print(const WFC::CartesianGrid<2, char>& topology, size_t w, size_t h)
 {
     for (size_t y = 0; y < h; y++)
     {
         for (size_t x = 0; x < w; x++)
         {
-            WFC::Node node = topology.nodes[WFC::CartesianTopology::getIndex<2>({x, y}, {w, h})];
-            if (node.states.size() == 1)
+            WFC::StateView<char> states = topology.getStates(WFC::CartesianTopology::getIndex<2>({x, y}, {w, h}));
+            if (states.size() == 1)
             {
-                std::cout << node.states[0];
+                std::cout << states[0];
             }
             else
             {
-                std::cout << node.states.size();
+                std::cout << states.size();
             }
         }
 
         std::cout << std::endl;
     }
 }
+
+void Pipes::print(const std::vector<char>& states, size_t w, size_t h)
+{
+    for (size_t y = 0; y < h; y++)
+    {
+        for (size_t x = 0; x < w; x++)
+        {
+            std::cout << states[WFC::CartesianTopology::getIndex<2>({x, y}, {w, h})];
+        }
+
+        std::cout << std::endl;
+    }
+}
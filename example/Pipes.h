@@ -1,15 +1,47 @@
 #pragma once
 
-#include "Topology.h"
+#include "CartesianTopology.h"
 
 #include <map>
 #include <array>
+#include <vector>
 
 namespace Pipes
 {
 
-WFC::Topology<char> create(size_t w, size_t h);
+// The pipes as a tileset known at compile time, for WFC::StaticGrid
+struct Tileset
+{
+    using State = char;
+    static constexpr size_t dimensions = 2;
+    static constexpr std::array<State, 12> states =
+    {
+        char(' '), char(179), char(180), char(191), char(192), char(193),
+        char(194), char(195), char(196), char(197), char(217), char(218),
+    };
+
+    static constexpr std::array<std::array<bool, 4>, 12> tokens =
+    { {
+        //l, r, u, d
+        { 0, 0, 0, 0 }, // ' '
+        { 0, 0, 1, 1 }, // │
+        { 1, 0, 1, 1 }, // ┤
+        { 1, 0, 0, 1 }, // ┐
+        { 0, 1, 1, 0 }, // └
+        { 1, 1, 1, 0 }, // ┴
+        { 1, 1, 0, 1 }, // ┬
+        { 0, 1, 1, 1 }, // ├
+        { 1, 1, 0, 0 }, // ─
+        { 1, 1, 1, 1 }, // ┼
+        { 1, 0, 1, 0 }, // ┘
+        { 0, 1, 0, 1 }, // ┌
+    } };
+};
+
+WFC::CartesianGrid<2, char> create(size_t w, size_t h, const std::array<bool, 2>& periods = { true, true });
+
+void print(const WFC::CartesianGrid<2, char>& topology, size_t w, size_t h);
 
-void print(const WFC::Topology<char>& topology, size_t w, size_t h);
+void print(const std::vector<char>& states, size_t w, size_t h);
 
 }
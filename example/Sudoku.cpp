@@ -6,28 +6,24 @@
 
 WFC::Topology<int> Sudoku::create()
 {
-    std::vector<int> states = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
-    WFC::Topology<int> topology;
-    topology.nodes = std::vector<WFC::Node<int>>(81);
-
-    for (size_t i = 0; i < topology.nodes.size(); i++)
+    WFC::Graph graph;
+    for (size_t i = 0; i < 81; i++)
     {
         auto [x, y] = Sudoku::getCoord(i);
-
-        topology.nodes[i].states = states;
+        std::vector<uint32_t> adjacent;
 
         // Horizontal line
         for (size_t xx = 0; xx < 9; xx++)
         {
             if (xx == x) continue;
-            topology.nodes[i].adjacent.push_back(&topology.nodes[Sudoku::getIndex(xx, y)]);
+            adjacent.push_back(Sudoku::getIndex(xx, y));
         }
 
         // Vertical line
         for (size_t yy = 0; yy < 9; yy++)
         {
             if (yy == y) continue;
-            topology.nodes[i].adjacent.push_back(&topology.nodes[Sudoku::getIndex(x, yy)]);
+            adjacent.push_back(Sudoku::getIndex(x, yy));
         }
 
         // Block
@@ -36,12 +32,15 @@ WFC::Topology<int> Sudoku::create()
             for (size_t yy = y / 3 * 3; yy < y / 3 * 3 + 3; yy++)
             {
                 if (xx == x || yy == y) continue;
-                topology.nodes[i].adjacent.push_back(&topology.nodes[Sudoku::getIndex(xx, yy)]);
+                adjacent.push_back(Sudoku::getIndex(xx, yy));
             }
         }
+
+        graph.addNode(adjacent);
     }
 
-    topology.compatible = [](const WFC::Node<int>&, const int& aState, const WFC::Node<int>&, const int& bState) { return aState != bState; };
+    WFC::Topology<int> topology({ 1, 2, 3, 4, 5, 6, 7, 8, 9 }, std::move(graph));
+    topology.compatible = [](size_t, const int& aState, size_t, size_t, const int& bState) { return aState != bState; };
     return topology;
 }
 
@@ -77,10 +76,10 @@ void Sudoku::print(const WFC::Topology<int>& topology)
         {
             if (x % 3 == 0) std::cout << char(0xB3);
 
-            WFC::Node node = topology.nodes[Sudoku::getIndex(x, y)];
-            if (node.states.size() == 1)
+            WFC::StateView<int> states = topology.getStates(Sudoku::getIndex(x, y));
+            if (states.size() == 1)
             {
-                std::cout << node.states[0];
+                std::cout << states[0];
             }
             else
             {
@@ -1,15 +1,23 @@
 #include "Pipes.h"
 #include "Sudoku.h"
 #include "Topology.h"
+#include "StaticGrid.h"
+#include "ChunkedCollapse.h"
+#include "ParallelCollapse.h"
+#include "StreamingCollapse.h"
+
+#include <cstdio>
+#include <fstream>
 
 void examplePipes()
 {
-    WFC::Topology<char> topology = Pipes::create(150, 10);
+    WFC::CartesianGrid<2, char> topology = Pipes::create(150, 10);
     topology.weights[' '] = 10;
     topology.weights[char(180)] = 0;
     topology.weights[char(193)] = 0;
     topology.weights[char(194)] = 0;
     topology.weights[char(195)] = 0;
+    topology.heuristic = WFC::Heuristic::Entropy;
 
     topology.collapse();
     Pipes::print(topology, 150, 10);
@@ -19,15 +27,197 @@ void exampleSudoku()
 {
     while (true)
     {
-        try
+        WFC::Topology<int> topology = Sudoku::create();
+        topology.backtracks = 1000;
+        if (topology.tryCollapse())
         {
-            WFC::Topology<int> topology = Sudoku::create();
-            topology.collapse();
             Sudoku::print(topology);
             break;
         }
-        catch(const std::runtime_error&)
-        { }
+    }
+}
+
+void exampleChunked()
+{
+    WFC::CartesianGrid<2, char> topology = Pipes::create(150, 10);
+    topology.weights[' '] = 10;
+
+    // Chunks of 50 x 10 nodes, the chunks of one color are collapsed concurrently
+    std::vector<char> states = WFC::CartesianTopology::collapseChunked<2>(topology, {50, 10}, 1);
+    Pipes::print(states, 150, 10);
+}
+
+void exampleRepair()
+{
+    WFC::CartesianGrid<2, char> topology = Pipes::create(150, 10);
+    topology.backtracks = 100;
+    topology.collapse(1);
+
+    // Collapse the nodes within 4 steps of the center again, the rest of the grid is kept
+    topology.repair({ WFC::CartesianTopology::getIndex<2>({75, 5}, {150, 10}) }, 4, 2);
+    Pipes::print(topology, 150, 10);
+}
+
+void exampleStream()
+{
+    // A window of 16 columns slides along the first axis, which is not periodic
+    WFC::CartesianGrid<2, char> window = Pipes::create(16, 10, { false, true });
+    std::vector<char> states(150 * 10);
+    size_t x = 0;
+    WFC::CartesianTopology::collapseStream<2, char>(
+        window,
+        [&states, &x](const std::vector<char>& column)
+        {
+            for (size_t y = 0; y < column.size(); y++)
+            {
+                states[WFC::CartesianTopology::getIndex<2>({x, y}, {150, 10})] = column[y];
+            }
+
+            return ++x < 150;
+        },
+        1);
+
+    Pipes::print(states, 150, 10);
+}
+
+void exampleOverlapping()
+{
+    const std::string sample =
+        "        "
+        " +--+   "
+        " |  |   "
+        " +--+-+ "
+        "    | | "
+        "    +-+ "
+        "        "
+        "        ";
+
+    // Patterns of 3 x 3 pixels that wrap around the sample
+    WFC::CartesianGrid<2, std::vector<char>> topology = WFC::CartesianTopology::createCartOverlapping<2, char>(
+        {150, 10}, std::vector<char>(sample.begin(), sample.end()), {8, 8}, 3, { true, true }, { true, true });
+    topology.backtracks = 1000;
+    topology.compile();
+    topology.collapse(1);
+
+    std::vector<char> states(topology.size());
+    for (size_t node = 0; node < topology.size(); node++)
+    {
+        states[node] = topology.getStates(node)[0][0];
+    }
+
+    Pipes::print(states, 150, 10);
+}
+
+void exampleStatic()
+{
+    WFC::StaticGrid<Pipes::Tileset> grid({150, 10}, { true, true });
+    grid.weights[0] = 10;
+    grid.collapse(1);
+
+    std::vector<char> states(grid.size());
+    for (size_t node = 0; node < grid.size(); node++)
+    {
+        states[node] = grid.getState(node);
+    }
+
+    Pipes::print(states, 150, 10);
+}
+
+void exampleSaveLoad()
+{
+    // Prepare the compiled topology once, then load it for the collapse
+    {
+        WFC::CartesianGrid<2, char> topology = Pipes::create(150, 10);
+        topology.weights[' '] = 10;
+        std::ofstream stream("pipes.wfc", std::ios::binary);
+        topology.save(stream);
+    }
+
+    WFC::CartesianGrid<2, char> topology = WFC::CartesianGrid<2, char>::load(WFC::Binary::readFile("pipes.wfc"));
+    std::remove("pipes.wfc");
+    topology.collapse(1);
+    Pipes::print(topology, 150, 10);
+}
+
+void exampleParallel()
+{
+    WFC::CartesianGrid<2, char> topology = Pipes::create(150, 10);
+    topology.weights[' '] = 10;
+
+    // The nodes with the lowest entropy of blocks of 8 x 8 nodes are collapsed in one pass
+    std::vector<char> states = WFC::CartesianTopology::collapseParallel<2>(topology, 1);
+    Pipes::print(states, 150, 10);
+}
+
+void exampleBatched()
+{
+    WFC::CartesianGrid<2, char> topology = Pipes::create(150, 10);
+    topology.weights[' '] = 10;
+    topology.compile();
+
+    // Up to 16 nodes more than 9 steps apart are decided per step, their waves stay within 4 steps until they are merged
+    topology.collapseBatched(16, 4, 1);
+    Pipes::print(topology, 150, 10);
+}
+
+void exampleSymmetric()
+{
+    // Only one tile per symmetry class, the rotated and reflected variants are generated
+    const std::map<char, std::pair<WFC::CartesianTopology::Symmetry, std::array<bool, 4>>> tiles
+    {
+        //                                                  l, r, u, d
+        { char(' '), { WFC::CartesianTopology::Symmetry::X, { 0, 0, 0, 0 } } }, // ' '
+        { char(179), { WFC::CartesianTopology::Symmetry::I, { 0, 0, 1, 1 } } }, // │
+        { char(191), { WFC::CartesianTopology::Symmetry::L, { 1, 0, 0, 1 } } }, // ┐
+        { char(193), { WFC::CartesianTopology::Symmetry::T, { 1, 1, 1, 0 } } }, // ┴
+        { char(197), { WFC::CartesianTopology::Symmetry::X, { 1, 1, 1, 1 } } }, // ┼
+    };
+
+    using Variant = WFC::CartesianTopology::Variant<char>;
+    WFC::CartesianGrid<2, Variant> topology = WFC::CartesianTopology::createCartSymmetric<char, bool>({150, 10}, tiles, { true, true }, { { ' ', 10.0f } });
+    topology.compile();
+    topology.collapse(1);
+
+    // Print the pipe with the tokens of each variant
+    std::map<std::array<bool, 4>, char> pipes;
+    for (size_t s = 0; s < Pipes::Tileset::states.size(); s++)
+    {
+        pipes[Pipes::Tileset::tokens[s]] = Pipes::Tileset::states[s];
+    }
+
+    std::vector<char> states(topology.size());
+    for (size_t node = 0; node < topology.size(); node++)
+    {
+        const Variant& variant = topology.getStates(node)[0];
+        std::array<bool, 4> tokens = tiles.at(variant.tile).second;
+        if (variant.mirrored)
+        {
+            std::swap(tokens[0], tokens[1]);
+        }
+
+        for (size_t r = 0; r < variant.rotation; r++)
+        {
+            // A clockwise quarter turn moves left to up, up to right, right to down and down to left
+            tokens = { tokens[3], tokens[2], tokens[0], tokens[1] };
+        }
+
+        states[node] = pipes.at(tokens);
+    }
+
+    Pipes::print(states, 150, 10);
+}
+
+void exampleReset()
+{
+    WFC::CartesianGrid<2, char> topology = Pipes::create(150, 10);
+    WFC::CartesianTopology::restrictRegion<2, char>(topology, {60, 3}, {90, 7}, { ' ' });
+
+    // The same topology is reused for every collapse, the restricted box is kept by reset
+    for (unsigned int seed = 1; seed <= 2; seed++)
+    {
+        topology.reset();
+        topology.collapse(seed);
+        Pipes::print(topology, 150, 10);
     }
 }
 
@@ -35,5 +225,15 @@ int main()
 {
     examplePipes();
     exampleSudoku();
+    exampleChunked();
+    exampleRepair();
+    exampleStream();
+    exampleOverlapping();
+    exampleStatic();
+    exampleSaveLoad();
+    exampleParallel();
+    exampleBatched();
+    exampleSymmetric();
+    exampleReset();
     return 0;
 }